@@ -0,0 +1,146 @@
+/**
+ * arena.c
+ * brief Size-class slab arena backing values too large for a slot.
+ *
+ * Every class is carved out of the table region (region.h) by arena_init().
+ * Blocks are handed out in address order until the class has used them
+ * all; freed blocks go on a per-class stack of indices, which alloc pops
+ * first. Blocks, stacks and counters all live in the region, so an
+ * attached process inherits the arena intact. Nothing here touches the heap.
+ */
+
+#include "arena.h"
+#include "region.h"
+#include "vegosh.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static_assert(VEGOSH_MAX_VALUE_LEN <= 65535,
+              "value lengths are 16 bits on the wire and in the slot");
+static_assert((ARENA_MIN_BLOCK << (ARENA_CLASSES - 1)) >= VEGOSH_MAX_VALUE_LEN,
+              "largest arena class must hold VEGOSH_MAX_VALUE_LEN bytes");
+
+#ifdef ARENA_CLASS_BLOCKS
+/** Block count of each class, as configured. */
+static const uint32_t class_blocks[] = ARENA_CLASS_BLOCKS;
+static_assert(sizeof(class_blocks) / sizeof(class_blocks[0]) == ARENA_CLASSES,
+              "ARENA_CLASS_BLOCKS needs exactly one count per size class");
+#define CLASS_BLOCKS(c) class_blocks[c]
+#else
+#define CLASS_BLOCKS(c) ((void)(c), (uint32_t)MAX_KEYS)
+#endif
+
+/**
+ * @struct ArenaClass
+ * @brief One size class: its blocks and the stack of free block indices.
+ */
+struct ArenaClass {
+    uint8_t  *blocks;     /* nblocks * block_size bytes of block storage */
+    uint32_t *free_stack; /* indices of freed blocks */
+    uint32_t *free_top;   /* number of entries in free_stack (in the region) */
+    uint32_t *fresh;      /* blocks [fresh, nblocks) never used (in the region) */
+    uint32_t  nblocks;
+    uint32_t  block_size;
+};
+
+static struct ArenaClass classes[ARENA_CLASSES];
+
+uint32_t arena_class_blocks(uint32_t c) {
+    return CLASS_BLOCKS(c);
+}
+
+size_t arena_region_bytes(void) {
+    size_t bytes = 2 * ARENA_CLASSES * sizeof(uint32_t) + ARENA_MIN_BLOCK;
+    for (uint32_t c = 0; c < ARENA_CLASSES; c++) {
+        bytes += (size_t)CLASS_BLOCKS(c) * (ARENA_MIN_BLOCK << c) + ARENA_MIN_BLOCK;
+        bytes += sizeof(uint32_t) * CLASS_BLOCKS(c) + ARENA_MIN_BLOCK;
+    }
+    return bytes;
+}
+
+/**
+ * Brief: Carves every size class out of the region. A fresh region needs
+ * no further setup: its free stacks are empty and every block is unused,
+ * which is exactly what the zero-filled counters say.
+ *
+ * @return 0 on success, -1 if the region is exhausted or a class has no
+ *         blocks or more than the 28-bit block index of a handle can name.
+ */
+int arena_init(void) {
+    uint32_t *counters = region_alloc(2 * sizeof(uint32_t) * ARENA_CLASSES,
+                                      ARENA_MIN_BLOCK);
+    if (!counters) {
+        fprintf(stderr, "arena: region exhausted\n");
+        return -1;
+    }
+
+    size_t total = 0;
+    for (uint32_t c = 0; c < ARENA_CLASSES; c++) {
+        struct ArenaClass *cls = &classes[c];
+
+        cls->block_size = ARENA_MIN_BLOCK << c;
+        cls->nblocks    = CLASS_BLOCKS(c);
+        if (cls->nblocks == 0 || cls->nblocks >= (1u << 28)) {
+            fprintf(stderr, "arena: class %u needs between 1 and 2^28 - 1 "
+                            "blocks, not %u\n", c, cls->nblocks);
+            return -1;
+        }
+
+        cls->free_top   = &counters[c];
+        cls->fresh      = &counters[ARENA_CLASSES + c];
+        cls->blocks     = region_alloc((size_t)cls->nblocks * cls->block_size,
+                                       ARENA_MIN_BLOCK);
+        cls->free_stack = region_alloc(sizeof(uint32_t) * cls->nblocks,
+                                       ARENA_MIN_BLOCK);
+        if (!cls->blocks || !cls->free_stack) {
+            fprintf(stderr, "arena: region exhausted\n");
+            return -1;
+        }
+        total += (size_t)cls->nblocks * cls->block_size;
+    }
+
+    printf("Arena: %d classes, %zu MB reserved\n", ARENA_CLASSES, total >> 20);
+    return 0;
+}
+
+/**
+ * Returns the smallest class whose blocks hold @p len bytes, or
+ * ARENA_CLASSES if none does.
+ */
+static inline uint32_t class_for(uint16_t len) {
+    uint32_t c = 0;
+    while (c < ARENA_CLASSES && (uint32_t)(ARENA_MIN_BLOCK << c) < len)
+        c++;
+    return c;
+}
+
+uint32_t arena_alloc(const uint8_t *data, uint16_t len) {
+    uint32_t c = class_for(len);
+    if (c == ARENA_CLASSES)
+        return ARENA_NULL;
+
+    /* Reuse a freed block first, so the touched part of a class stays
+     * as small as the working set allows. */
+    struct ArenaClass *cls = &classes[c];
+    uint32_t index;
+    if (*cls->free_top > 0)
+        index = cls->free_stack[--*cls->free_top];
+    else if (*cls->fresh < cls->nblocks)
+        index = (*cls->fresh)++;
+    else
+        return ARENA_NULL;
+
+    memcpy(cls->blocks + (size_t)index * cls->block_size, data, len);
+    return (c << 28) | index;
+}
+
+void arena_free(uint32_t handle) {
+    struct ArenaClass *cls = &classes[handle >> 28];
+    cls->free_stack[(*cls->free_top)++] = handle & 0x0FFFFFFF;
+}
+
+uint8_t *arena_ptr(uint32_t handle) {
+    struct ArenaClass *cls = &classes[handle >> 28];
+    return cls->blocks + (size_t)(handle & 0x0FFFFFFF) * cls->block_size;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file arena.h
+ * @brief Statically preallocated slab arena for out-of-line values.
+ *
+ * Values longer than a table variant's inline width live here instead of
+ * in the slot; the slot keeps a 4-byte handle in its value field.
+ *
+ * The arena is split into ARENA_CLASSES size classes of ARENA_MIN_BLOCK,
+ * 2×, 4×, … bytes. Each class is one aligned run of blocks carved from the
+ * table region at startup, plus a count of blocks never handed out and a
+ * stack of freed block indices, so alloc/free are O(1) and never touch
+ * malloc.
+ *
+ * The region is zero-filled on demand (region.h), so a class only costs
+ * memory for blocks that have actually been used. That makes it cheap to
+ * reserve MAX_KEYS blocks in every class: each key holds at most one
+ * block, so by default the arena cannot run out before the key cap does.
+ *
+ * Handle layout: [class:4][block index:28]. ARENA_NULL means "no block".
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "vegosh.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/** Smallest block size; also the alignment of every block. */
+#define ARENA_MIN_BLOCK 64
+
+/**
+ * Number of size classes: as many doublings of ARENA_MIN_BLOCK as it takes
+ * to hold VEGOSH_MAX_VALUE_LEN bytes, i.e. 5 (64 … 1024 bytes) by default.
+ * Derived rather than configured, so raising the value limit adds classes.
+ */
+#define ARENA_CLASSES                                                        \
+    (VEGOSH_MAX_VALUE_LEN <= 64    ?  1 : VEGOSH_MAX_VALUE_LEN <= 128   ?  2 : \
+     VEGOSH_MAX_VALUE_LEN <= 256   ?  3 : VEGOSH_MAX_VALUE_LEN <= 512   ?  4 : \
+     VEGOSH_MAX_VALUE_LEN <= 1024  ?  5 : VEGOSH_MAX_VALUE_LEN <= 2048  ?  6 : \
+     VEGOSH_MAX_VALUE_LEN <= 4096  ?  7 : VEGOSH_MAX_VALUE_LEN <= 8192  ?  8 : \
+     VEGOSH_MAX_VALUE_LEN <= 16384 ?  9 : VEGOSH_MAX_VALUE_LEN <= 32768 ? 10 : 11)
+
+/*
+ * Blocks reserved per size class. By default every class gets MAX_KEYS.
+ * Define ARENA_CLASS_BLOCKS to a list with one non-zero count per class,
+ * smallest first, e.g. -DARENA_CLASS_BLOCKS="{ 1000000, 500000, 100000,
+ * 10000, 1000 }", to cap the address space (and hot-restart memfd size) of
+ * a table whose value sizes are known. A class that fills up then rejects
+ * writes with ARENA_FULL. A list of the wrong length fails to compile and
+ * a zero count fails arena_init().
+ */
+
+/** Invalid handle, returned when a class is exhausted. */
+#define ARENA_NULL 0xFFFFFFFFu
+
+/** @brief Blocks reserved in size class @p c (ARENA_CLASS_BLOCKS). */
+uint32_t arena_class_blocks(uint32_t c);
+
+/** @brief Region bytes arena_init() needs, including alignment slack. */
+size_t arena_region_bytes(void);
+
+/**
+ * @brief Carves every size class out of the region, or adopts the existing
+ *        classes if the region was inherited.
+ * @return 0 on success, -1 if the region is exhausted or a class has no
+ *         blocks or is too large for the handle's block index.
+ */
+int arena_init(void);
+
+/**
+ * @brief Takes a block large enough for @p len bytes and copies @p data in.
+ * @return Handle of the block, or ARENA_NULL if its class is exhausted.
+ */
+uint32_t arena_alloc(const uint8_t *data, uint16_t len);
+
+/** @brief Returns the block behind @p handle to its class's free stack. */
+void arena_free(uint32_t handle);
+
+/** @brief Returns the address of the block behind @p handle. */
+uint8_t *arena_ptr(uint32_t handle);
+
+#endif /* ARENA_H */
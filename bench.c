@@ -0,0 +1,113 @@
+/**
+ * bench.c
+ * brief In-process lookup benchmark: live table versus frozen index.
+ *
+ * Runs without the network so the numbers reflect the hash table alone:
+ * fill the table to MAX_KEYS, time random hits and misses through
+ * get_ref(), then freeze and time the same key sequence again.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "vegosh.h"
+
+/** Lookups timed per round. */
+#define BENCH_LOOKUPS 10000000
+
+/** Rounds per measurement; the fastest is reported, which filters out
+ *  interference from other tenants of a shared machine. */
+#define BENCH_ROUNDS 5
+
+/** Returns a monotonic timestamp in nanoseconds. */
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** xorshift64: cheap enough not to show up in the timings. */
+static inline uint64_t next_rand(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/** Writes the zero-padded key for entry @p n into @p key. */
+static inline void make_key(uint8_t *key, uint64_t n) {
+    memset(key, 0, VEGOSH_MAX_KEY_SIZE);
+    memcpy(key, &n, sizeof(n));
+}
+
+/**
+ * Times BENCH_LOOKUPS random lookups; keys >= MAX_KEYS are misses.
+ * @return Average nanoseconds per lookup.
+ */
+static double time_lookups(uint64_t key_space) {
+    uint8_t  key[VEGOSH_MAX_KEY_SIZE];
+    const uint8_t *value;
+    uint16_t value_len;
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    size_t   found = 0;
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < BENCH_LOOKUPS; i++) {
+        make_key(key, next_rand(&state) % key_space);
+        found += (get_ref(key, &value, &value_len, NULL) == 0);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    /* Keep the lookups observable so they are not optimised away. */
+    if (found == (size_t)-1)
+        printf("unreachable\n");
+    return (double)elapsed / BENCH_LOOKUPS;
+}
+
+/** Best of BENCH_ROUNDS time_lookups(@p key_space) runs. */
+static double best_lookups(uint64_t key_space) {
+    double best = time_lookups(key_space);
+    for (int round = 1; round < BENCH_ROUNDS; round++) {
+        double ns = time_lookups(key_space);
+        if (ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+/** Times hits and misses against whatever table is currently active. */
+static void run_phase(const char *name) {
+    double hit  = best_lookups(MAX_KEYS);
+    double miss = best_lookups((uint64_t)MAX_KEYS * 1000); /* ~all misses */
+    printf("%-7s  hit %6.1f ns  miss %6.1f ns  table %6.1f MB\n",
+           name, hit, miss, vegosh_footprint() / (1024.0 * 1024.0));
+}
+
+/**
+ * @brief Fills a table of the given variant and prints live vs frozen
+ * lookup latency and memory footprint.
+ */
+int startBench(size_t slot_size) {
+    if (initializevegosh(slot_size, 0) == -1)
+        return -1;
+
+    uint8_t  key[VEGOSH_MAX_KEY_SIZE];
+    uint8_t  value[VEGOSH_MAX_VALUE_SIZE] = {0};
+    uint16_t value_len = 8;
+    for (uint64_t n = 0; n < MAX_KEYS; n++) {
+        make_key(key, n);
+        memcpy(value, &n, sizeof(n));
+        if (insert(key, value, &value_len) < 0) {
+            fprintf(stderr, "bench: insert failed at %llu\n",
+                    (unsigned long long)n);
+            return -1;
+        }
+    }
+
+    run_phase("live");
+    if (vegosh_freeze() != 0)
+        return -1;
+    run_phase("frozen");
+    return 0;
+}
@@ -0,0 +1,8 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+
+int startBench(size_t slot_size);
+
+#endif /* BENCH_H */
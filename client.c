@@ -1,14 +1,23 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include "netUtils.h"
 #include "protocol.h"
+#include "vegosh.h"
+
+/* Stringify a numeric macro for use as a scanf field width. */
+#define STR_(x) #x
+#define STR(x)  STR_(x)
+
+/** Entries in the near cache. Must be a power of two. */
+#define NEAR_CACHE_SLOTS 1024
 
 /**
  * @brief Wire-format request structure sent to the server.
  *
  * Layout:
- *   [opcode:1][key_len:1][val_len:1][key][value]
+ *   [opcode:1][key_len:1][val_len:2][key][value]
  *
  * key and value buffers are fixed-size but only the first
  * key_len / val_len bytes are transmitted.
@@ -16,9 +25,9 @@
 typedef struct {
     uint8_t opcode;
     uint8_t key_len;
-    uint8_t val_len;
-    char key[16];
-    char val[32];
+    uint16_t val_len;
+    char key[VEGOSH_MAX_KEY_SIZE];
+    char val[VEGOSH_MAX_VALUE_LEN];
 } Request;
 
 /**
@@ -30,9 +39,105 @@ typedef struct {
 typedef struct {
     uint8_t opcode;
     char key[256];
-    char val[256];
+    char val[VEGOSH_MAX_VALUE_LEN + 1];
+    uint32_t version; /* CAS only */
 } Command;
 
+/**
+ * @brief One near cache entry: a value this client read while tracking.
+ */
+typedef struct {
+    uint8_t  used;
+    uint8_t  key[VEGOSH_MAX_KEY_SIZE]; /* zero padded, as the server pads */
+    uint32_t version;
+    uint16_t val_len;
+    uint8_t  val[VEGOSH_MAX_VALUE_LEN];
+} NearEntry;
+
+/**
+ * Bounded, direct-mapped local cache of GET results. Only used while
+ * TRACKING is on; this client's own writes drop their keys, and the
+ * INVALIDATE pushed after a hot restart clears it (track.h).
+ */
+static NearEntry nearCache[NEAR_CACHE_SLOTS];
+static int       tracking = 0;
+
+/** Slot of the zero-padded @p key (FNV-1a). */
+static NearEntry *nearSlot(const uint8_t *key) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < VEGOSH_MAX_KEY_SIZE; i++)
+        h = (h ^ key[i]) * 16777619u;
+    return &nearCache[h & (NEAR_CACHE_SLOTS - 1)];
+}
+
+/** Cached entry for the zero-padded @p key, or NULL. */
+static NearEntry *nearLookup(const uint8_t *key) {
+    NearEntry *e = nearSlot(key);
+    return (e->used && memcmp(e->key, key, VEGOSH_MAX_KEY_SIZE) == 0) ? e : NULL;
+}
+
+/** Drops @p key from the cache if present. */
+static void nearDrop(const uint8_t *key) {
+    NearEntry *e = nearLookup(key);
+    if (e)
+        e->used = 0;
+}
+
+/** Caches a GET result, replacing whatever shared its slot. */
+static void nearStore(const uint8_t *key, uint32_t version,
+                      const uint8_t *val, uint16_t val_len) {
+    NearEntry *e = nearSlot(key);
+    e->used    = 1;
+    memcpy(e->key, key, VEGOSH_MAX_KEY_SIZE);
+    e->version = version;
+    e->val_len = val_len;
+    memcpy(e->val, val, val_len);
+}
+
+/** Drops every cached entry. */
+static void nearClear(void) {
+    for (size_t i = 0; i < NEAR_CACHE_SLOTS; i++)
+        nearCache[i].used = 0;
+}
+
+/**
+ * @brief Reads the status byte of a reply, clearing the near cache for any
+ * INVALIDATE push the server sent ahead of it.
+ *
+ * @return 0 with *response set, or -1 if the connection failed.
+ */
+static int readStatus(int connfd, uint8_t *response) {
+    for (;;) {
+        if (readn(connfd, response, 1) <= 0)
+            return -1;
+        if (*response != INVALIDATE)
+            return 0;
+        nearClear();
+    }
+}
+
+/**
+ * @brief Switches TRACKING, and with it the near cache.
+ *
+ * The cache starts empty either way: nothing read before tracking was on
+ * is covered by the hot-restart flush.
+ *
+ * @return 0 on success, -1 if the connection failed.
+ */
+static int trackingCommand(int connfd, int on) {
+    uint8_t req[2] = { 0x09, (uint8_t)on };
+    writen(connfd, req, sizeof(req));
+
+    uint8_t response;
+    if (readStatus(connfd, &response) == -1)
+        return -1;
+    nearClear();
+    tracking = on && response == SUCCESS;
+    printf(response == SUCCESS ? "OK\n" : "ERR: unknown response 0x%02x\n",
+           response);
+    return 0;
+}
+
 /**
  * @brief Builds a Request from a parsed Command.
  *
@@ -43,6 +148,61 @@ typedef struct {
  */
 
 
+/**
+ * @brief Sends one SCAN request and prints the returned batch.
+ *
+ * Prints each entry as key=value, then the cursor to pass to the next
+ * SCAN (0 once the whole table has been returned).
+ *
+ * @return 0 on success, -1 if the connection failed.
+ */
+static int scanCommand(int connfd, uint32_t cursor, uint16_t count) {
+    uint8_t req[7] = { 0x07, count >> 8, count & 0xFF,
+                       cursor >> 24, cursor >> 16, cursor >> 8, cursor & 0xFF };
+    writen(connfd, req, sizeof(req));
+
+    uint8_t response;
+    if (readStatus(connfd, &response) == -1)
+        return -1;
+    if (response == CURSOR_INVALID) {
+        printf("ERR: stale cursor, start again from 0\n");
+        return 0;
+    }
+    if (response != SUCCESS) {
+        printf("ERR: unknown response 0x%02x\n", response);
+        return 0;
+    }
+
+    uint8_t key_size;
+    readn(connfd, &key_size, 1);
+    for (;;) {
+        uint8_t more;
+        if (readn(connfd, &more, 1) <= 0)
+            return -1;
+        if (!more)
+            break;
+
+        uint16_t vlen;
+        uint8_t  key[VEGOSH_MAX_KEY_SIZE];
+        uint8_t  val[VEGOSH_MAX_VALUE_LEN];
+        readn(connfd, &vlen, 2);
+        vlen = ntohs(vlen);
+        if (key_size > sizeof(key) || vlen > sizeof(val)) {
+            fprintf(stderr, "entry too long\n");
+            return -1;
+        }
+        readn(connfd, key, key_size);
+        readn(connfd, val, vlen);
+        printf("%.*s=%.*s\n", (int)strnlen((char *)key, key_size), key,
+               (int)vlen, val);
+    }
+
+    uint32_t next;
+    readn(connfd, &next, 4);
+    printf("cursor %u\n", ntohl(next));
+    return 0;
+}
+
 /**
  * @brief Interactive client loop.
  *
@@ -52,9 +212,19 @@ typedef struct {
  * Supported commands:
  *   SET <key> <value>
  *   GET <key>
+ *   SNAPSHOT
+ *   FREEZE
+ *   THAW
+ *   TRACE
+ *   SCAN [cursor] [count]
+ *   CAS <key> <expected version> <value>
+ *   TRACKING ON|OFF
+ *
+ * With TRACKING ON, GET answers keys it has read before from the near
+ * cache, without a round trip, until the server invalidates them.
  */
 void shellLoop(int connfd) {
-    char line[1024];
+    char line[VEGOSH_MAX_VALUE_LEN + 512];
 
     /* Read–eval–print loop. */
     while (1) {
@@ -71,7 +241,8 @@ void shellLoop(int connfd) {
         char op[16];
 
         /* Parse user input into op/key/value tokens. */
-        int n = sscanf(line, "%15s %255s %255s", op, cmd.key, cmd.val);
+        int n = sscanf(line, "%15s %255s %" STR(VEGOSH_MAX_VALUE_LEN) "s",
+                       op, cmd.key, cmd.val);
         if (n < 1)
             continue;
 
@@ -80,36 +251,91 @@ void shellLoop(int connfd) {
             cmd.opcode = 0x02;
         else if (strcmp(op, "SET") == 0 && n >= 3)
             cmd.opcode = 0x01;
+        else if (strcmp(op, "SNAPSHOT") == 0)
+            cmd.opcode = 0x03;
+        else if (strcmp(op, "FREEZE") == 0)
+            cmd.opcode = 0x04;
+        else if (strcmp(op, "THAW") == 0)
+            cmd.opcode = 0x05;
+        else if (strcmp(op, "TRACE") == 0)
+            cmd.opcode = 0x06;
+        else if (strcmp(op, "CAS") == 0 &&
+                 sscanf(line, "%*s %255s %u %" STR(VEGOSH_MAX_VALUE_LEN) "s",
+                        cmd.key, &cmd.version, cmd.val) == 3)
+            cmd.opcode = 0x08;
+        else if (strcmp(op, "SCAN") == 0) {
+            /* SCAN has its own request layout and multi-entry reply. */
+            uint32_t cursor = (n >= 2) ? strtoul(cmd.key, NULL, 10) : 0;
+            uint16_t count  = (n >= 3) ? strtoul(cmd.val, NULL, 10) : 0;
+            if (scanCommand(connfd, cursor, count) == -1)
+                break;
+            continue;
+        }
+        else if (strcmp(op, "TRACKING") == 0 && n >= 2) {
+            if (trackingCommand(connfd, strcmp(cmd.key, "ON") == 0) == -1)
+                break;
+            continue;
+        }
         else {
             fprintf(stderr, "Unknown command\n");
             continue;
         }
 
         uint8_t key_len = (uint8_t)strlen(cmd.key);
-        uint8_t val_len = (uint8_t)strlen(cmd.val);
+        size_t  val_len = strlen(cmd.val);
+
+        /* Enforce protocol size limits before sending. The server applies
+         * the tighter limits of whichever table variant it runs. */
+        if (key_len > VEGOSH_MAX_KEY_SIZE)   { fprintf(stderr, "key too long\n");   continue; }
+        if (val_len > VEGOSH_MAX_VALUE_LEN)  { fprintf(stderr, "value too long\n"); continue; }
 
-        /* Enforce protocol size limits before sending. */
-        if (key_len > 16) { fprintf(stderr, "key too long\n");   continue; }
-        if (val_len > 32) { fprintf(stderr, "value too long\n"); continue; }
+        uint8_t padded[VEGOSH_MAX_KEY_SIZE] = {0};
+        memcpy(padded, cmd.key, key_len);
+
+        /* Near cache: answer a tracked key locally. */
+        if (cmd.opcode == 0x02 && tracking) {
+            const NearEntry *e = nearLookup(padded);
+            if (e) {
+                printf("OK (cached)\nversion %u\n%.*s\n", e->version,
+                       (int)e->val_len, e->val);
+                continue;
+            }
+        }
+
+        /* Our own write makes the cached copy stale. */
+        if (cmd.opcode == 0x01 || cmd.opcode == 0x08)
+            nearDrop(padded);
 
         /* Send wire format:
-         *   opcode [key_len] [val_len] key [value]
-         * Note: GET does not include val_len or value.
+         *   opcode [key_len] [val_len:2] [expected:4] key [value]
+         * Note: only CAS carries the expected version, GET does not include
+         * val_len or value, and SNAPSHOT, FREEZE, THAW and TRACE are the
+         * opcode alone.
          */
+        int bare = (cmd.opcode == 0x03 || cmd.opcode == 0x04 ||
+                    cmd.opcode == 0x05 || cmd.opcode == 0x06);
         writen(connfd, &cmd.opcode, 1);
-        writen(connfd, &key_len,    1);
+        if (!bare)
+            writen(connfd, &key_len, 1);
 
-        if (cmd.opcode == 0x01)
-            writen(connfd, &val_len, 1);
+        if (cmd.opcode == 0x01 || cmd.opcode == 0x08) {
+            uint16_t wire_len = htons((uint16_t)val_len);
+            writen(connfd, &wire_len, 2);
+        }
+
+        if (cmd.opcode == 0x08) {
+            uint32_t wire_version = htonl(cmd.version);
+            writen(connfd, &wire_version, 4);
+        }
 
         writen(connfd, cmd.key, key_len);
 
-        if (cmd.opcode == 0x01)
+        if (cmd.opcode == 0x01 || cmd.opcode == 0x08)
             writen(connfd, cmd.val, val_len);
 
         /* Read server status byte. */
         uint8_t response;
-        if (readn(connfd, &response, 1) == -1) {
+        if (readStatus(connfd, &response) == -1) {
             perror("readn");
             break;
         }
@@ -120,20 +346,58 @@ void shellLoop(int connfd) {
             case KEY_NOT_FOUND:         printf("ERR: key not found\n");  break;
             case KEY_EXISTS_UPDATED:    printf("OK: key updated\n");     break;
             case MAX_KEY_LIMIT_REACHED: printf("ERR: store full\n");     break;
+            case INVALID_OPCODE:        printf("ERR: invalid request\n"); break;
+            case SNAPSHOT_IN_PROGRESS:  printf("ERR: snapshot in progress\n"); break;
+            case TABLE_FROZEN:          printf("ERR: table is frozen\n"); break;
+            case VERSION_CONFLICT:      printf("ERR: version conflict\n"); break;
+            case ARENA_FULL:            printf("ERR: value arena full\n"); break;
             default:
                 printf("ERR: unknown response 0x%02x\n", response);
                 break;
         }
 
+        /* GET and CAS replies carry the entry's version. */
+        uint32_t version = 0;
+        if ((cmd.opcode == 0x02 && response == SUCCESS) ||
+            (cmd.opcode == 0x08 && (response == SUCCESS ||
+                                    response == VERSION_CONFLICT))) {
+            readn(connfd, &version, 4);
+            version = ntohl(version);
+            printf("version %u\n", version);
+        }
+
         /* For successful GET, read and print returned value. */
         if (cmd.opcode == 0x02 && response == SUCCESS) {
-            uint8_t vlen;
-            uint8_t val[32];
+            uint16_t vlen;
+            uint8_t  val[VEGOSH_MAX_VALUE_LEN];
 
-            readn(connfd, &vlen, 1);
+            readn(connfd, &vlen, 2);
+            vlen = ntohs(vlen);
+            if (vlen > sizeof(val)) {
+                fprintf(stderr, "value too long\n");
+                break;
+            }
             readn(connfd, val,   vlen);
 
             printf("%.*s\n", (int)vlen, val);
+            if (tracking)
+                nearStore(padded, version, val, vlen);
+        }
+
+        /* For TRACE, stream the returned text to stdout. */
+        if (cmd.opcode == 0x06 && response == SUCCESS) {
+            uint32_t tlen;
+            char     chunk[4096];
+
+            readn(connfd, &tlen, 4);
+            tlen = ntohl(tlen);
+            while (tlen > 0) {
+                size_t n = tlen < sizeof(chunk) ? tlen : sizeof(chunk);
+                if (readn(connfd, chunk, n) <= 0)
+                    break;
+                fwrite(chunk, 1, n, stdout);
+                tlen -= n;
+            }
         }
     }
 }
@@ -0,0 +1,258 @@
+/**
+ * handoff.c
+ * brief SCM_RIGHTS transfer of the table memfd and server sockets.
+ */
+
+#define _GNU_SOURCE
+#include "handoff.h"
+#include "region.h"
+#include "snapshot.h"
+#include "trace.h"
+#include "track.h"
+#include "vegosh.h"
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/** Most descriptors ever sent in one message. */
+#define HANDOFF_MAX_FDS 4
+
+/** Fills @p addr with the abstract socket address; returns its length. */
+static socklen_t handoff_addr(struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    /* sun_path[0] stays NUL: abstract namespace, nothing to unlink. */
+    memcpy(addr->sun_path + 1, HANDOFF_SOCKET, strlen(HANDOFF_SOCKET));
+    return offsetof(struct sockaddr_un, sun_path) + 1 + strlen(HANDOFF_SOCKET);
+}
+
+int handoff_listen(void) {
+    struct sockaddr_un addr;
+    socklen_t len = handoff_addr(&addr);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("handoff socket");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, len) == -1 || listen(fd, 1) == -1) {
+        perror("handoff bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/** Sends @p msg with @p nfds descriptors attached. */
+static int send_fds(int sock, const struct HandoffMsg *msg,
+                    const int *fds, int nfds) {
+    union {
+        char           buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct iovec  iov = { .iov_base = (void *)msg, .iov_len = sizeof(*msg) };
+    struct msghdr mh  = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+    if (nfds > 0) {
+        memset(&control, 0, sizeof(control));
+        mh.msg_control    = control.buf;
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type  = SCM_RIGHTS;
+        cm->cmsg_len   = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(cm), fds, sizeof(int) * nfds);
+    }
+
+    return sendmsg(sock, &mh, MSG_NOSIGNAL) == (ssize_t)sizeof(*msg) ? 0 : -1;
+}
+
+/**
+ * Reads exactly @p len bytes from @p sock, giving up if the peer closes or
+ * stays silent for HANDOFF_TIMEOUT_MS.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+static int recv_timed(int sock, void *buf, size_t len) {
+    struct pollfd pfd = { .fd = sock, .events = POLLIN };
+    size_t got = 0;
+
+    while (got < len) {
+        int ready = poll(&pfd, 1, HANDOFF_TIMEOUT_MS);
+        if (ready == -1 && errno == EINTR)
+            continue;
+        if (ready <= 0)
+            return -1;
+        ssize_t n = recv(sock, (uint8_t *)buf + got, len - got, 0);
+        if (n <= 0)
+            return -1;
+        got += n;
+    }
+    return 0;
+}
+
+/** Sends one confirmation byte. @return 0 on success, -1 on failure. */
+static int send_byte(int sock, uint8_t byte) {
+    return send(sock, &byte, 1, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+int handoff_send(int handoff_fd, int listenfd, int connfd) {
+    int peer = accept(handoff_fd, NULL, NULL);
+    if (peer == -1) {
+        perror("handoff accept");
+        return -1;
+    }
+
+    struct HandoffMsg msg = {0};
+
+    /* The abstract socket has no filesystem permissions to keep other
+     * users out, so check who connected before handing over the table. */
+    struct ucred cred;
+    socklen_t    cred_len = sizeof(cred);
+    if (getsockopt(peer, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1 ||
+        cred.uid != geteuid()) {
+        fprintf(stderr, "Hot restart refused: requested by another user\n");
+        send_fds(peer, &msg, NULL, 0);
+        close(peer);
+        return 1;
+    }
+
+    /* The new binary must lay out the region exactly as this one did. The
+     * slot size is this server's to announce, so it is left out. */
+    struct VegoshLayout theirs, ours;
+    vegosh_layout(0, &ours);
+    if (recv_timed(peer, &theirs, sizeof(theirs)) == -1 ||
+        memcmp(&theirs, &ours, sizeof(ours)) != 0) {
+        fprintf(stderr, "Hot restart refused: new binary uses another "
+                        "region layout\n");
+        send_fds(peer, &msg, NULL, 0);
+        close(peer);
+        return 1;
+    }
+
+    if (vegosh_frozen()) {
+        fprintf(stderr, "Hot restart refused: table is frozen, THAW first\n");
+        send_fds(peer, &msg, NULL, 0);
+        close(peer);
+        return 1;
+    }
+
+    /* The memfd must hold every write before anyone else maps it. */
+    if (snapshot_wait() == -1 || region_private()) {
+        fprintf(stderr, "Hot restart refused: region could not be merged\n");
+        send_fds(peer, &msg, NULL, 0);
+        close(peer);
+        return 1;
+    }
+
+    int fds[HANDOFF_MAX_FDS] = { region_fd(), listenfd, handoff_fd, connfd };
+    msg.slot_size   = (uint32_t)vegosh_slot_size();
+    msg.has_conn    = (connfd != -1);
+    msg.tracking    = (connfd != -1) && track_enabled();
+    msg.trace_every = trace_rate();
+
+    if (send_fds(peer, &msg, fds, msg.has_conn ? 4 : 3) == -1) {
+        perror("handoff sendmsg");
+        close(peer);
+        return -1;
+    }
+
+    /* The new process only holds copies of the descriptors, so until it
+     * confirms, backing out just means carrying on. */
+    uint8_t ready = 0;
+    if (recv_timed(peer, &ready, 1) == -1 || ready != HANDOFF_READY ||
+        send_byte(peer, HANDOFF_COMMIT) == -1) {
+        fprintf(stderr, "Hot restart aborted: the new process did not "
+                        "start; still serving\n");
+        close(peer);
+        return 1;
+    }
+    close(peer);
+    return 0;
+}
+
+int handoff_receive(struct Handoff *h) {
+    struct sockaddr_un addr;
+    socklen_t len = handoff_addr(&addr);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1 || connect(sock, (struct sockaddr *)&addr, len) == -1) {
+        perror("handoff connect");
+        if (sock != -1)
+            close(sock);
+        return -1;
+    }
+
+    struct VegoshLayout layout;
+    vegosh_layout(0, &layout);
+    if (send(sock, &layout, sizeof(layout), MSG_NOSIGNAL) != sizeof(layout)) {
+        perror("handoff send");
+        close(sock);
+        return -1;
+    }
+
+    union {
+        char           buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct HandoffMsg msg = {0};
+    struct iovec  iov = { .iov_base = &msg, .iov_len = sizeof(msg) };
+    struct msghdr mh  = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+
+    /* The server waits for the layout before answering, so it may take
+     * up to the next request boundary; a refusal carries no descriptors. */
+    ssize_t n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    if (n != (ssize_t)sizeof(msg) || msg.slot_size == 0) {
+        fprintf(stderr, "Takeover refused by the running server\n");
+        close(sock);
+        return -1;
+    }
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    int nfds = msg.has_conn ? 4 : 3;
+    if (!cm || cm->cmsg_type != SCM_RIGHTS ||
+        cm->cmsg_len != CMSG_LEN(sizeof(int) * nfds)) {
+        fprintf(stderr, "Takeover: malformed handoff message\n");
+        close(sock);
+        return -1;
+    }
+
+    int fds[HANDOFF_MAX_FDS] = { -1, -1, -1, -1 };
+    memcpy(fds, CMSG_DATA(cm), sizeof(int) * nfds);
+
+    h->slot_size   = msg.slot_size;
+    h->memfd       = fds[0];
+    h->listenfd    = fds[1];
+    h->handoff_fd  = fds[2];
+    h->connfd      = fds[3];
+    h->tracking    = msg.tracking;
+    h->trace_every = msg.trace_every;
+    h->sock        = sock;
+
+    return region_attach(h->memfd);
+}
+
+int handoff_confirm(struct Handoff *h) {
+    uint8_t commit = 0;
+    int ok = send_byte(h->sock, HANDOFF_READY) == 0 &&
+             recv_timed(h->sock, &commit, 1) == 0 && commit == HANDOFF_COMMIT;
+    close(h->sock);
+    h->sock = -1;
+    if (!ok) {
+        fprintf(stderr, "Takeover aborted: the running server kept "
+                        "serving\n");
+        return -1;
+    }
+    return 0;
+}
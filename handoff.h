@@ -0,0 +1,112 @@
+/**
+ * @file handoff.h
+ * @brief Hot restart: passing the table and sockets to a new process.
+ *
+ * A server started in hot-restart mode keeps its table in a memfd (see
+ * region.h) and listens on the abstract Unix socket HANDOFF_SOCKET. A new
+ * binary started with "vegosh takeover" connects to it and sends its
+ * struct VegoshLayout (vegosh.h). At the next request boundary the old
+ * server checks that layout against its own, then sends, via SCM_RIGHTS:
+ *
+ *   [memfd] [TCP listening socket] [handoff socket] [client connection]
+ *
+ * together with a struct HandoffMsg. The new process maps the same memfd,
+ * so restart time does not depend on table size, and it inherits the
+ * listening socket, so the kernel keeps queueing connection attempts
+ * throughout. The in-flight client connection, if any, moves across too,
+ * with any unread request bytes still in its socket buffer.
+ *
+ * Neither side serves until both agree:
+ *
+ *   new → old  HANDOFF_READY   the region is attached and validated
+ *   old → new  HANDOFF_COMMIT  the old server stops and exits
+ *
+ * If the new process fails or stays silent for HANDOFF_TIMEOUT_MS, the old
+ * server closes the handoff connection and keeps serving; a new process
+ * that sees the connection close without a commit exits without serving.
+ */
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdint.h>
+
+/** Abstract-namespace socket name (leading NUL added by the code). */
+#define HANDOFF_SOCKET "vegosh-handoff-8080"
+
+/** Longest either side waits for the other's next handoff message. */
+#define HANDOFF_TIMEOUT_MS 5000
+
+/** Confirmation bytes; see the protocol above. */
+#define HANDOFF_READY  'R'
+#define HANDOFF_COMMIT 'C'
+
+/**
+ * @struct HandoffMsg
+ * @brief Data sent alongside the file descriptors.
+ */
+struct HandoffMsg {
+    uint32_t slot_size;   /* variant of the handed-off table; 0 = refused */
+    uint32_t has_conn;    /* 1 if a client connection is included */
+    uint32_t tracking;    /* 1 if that connection has key tracking on */
+    uint32_t trace_every; /* sampling period of the tracer (trace.h) */
+};
+
+/**
+ * @struct Handoff
+ * @brief Everything the new process receives.
+ */
+struct Handoff {
+    uint32_t slot_size;
+    int      memfd;
+    int      listenfd;
+    int      handoff_fd;
+    int      connfd;      /* -1 if the old server was idle */
+    int      tracking;    /* connfd had key tracking on (track.h) */
+    uint32_t trace_every; /* the old server's --trace period, 0 if off */
+    int      sock;        /* handoff connection, open until confirmed */
+};
+
+/**
+ * @brief Creates the listening handoff socket.
+ * @return Its file descriptor, or -1 on failure.
+ */
+int handoff_listen(void);
+
+/**
+ * @brief Accepts the waiting takeover request on @p handoff_fd and sends
+ *        the region memfd, both listening sockets and @p connfd (or -1).
+ *
+ * Refuses, and leaves this server running, if the peer runs as another
+ * user (SO_PEERCRED; an abstract socket has no file permissions), or while
+ * the table is frozen, since the frozen index is private memory. Waits for a running snapshot
+ * to finish first so its private pages are merged back into the memfd,
+ * and refuses if that merge fails: the memfd would be missing writes.
+ *
+ * Refuses as well if the new process's layout differs from this one's, and
+ * backs out if it does not confirm with HANDOFF_READY in time.
+ *
+ * @return 0 if the state was handed off and this process should exit,
+ *         1 if the request was refused or not confirmed, -1 on error.
+ */
+int handoff_send(int handoff_fd, int listenfd, int connfd);
+
+/**
+ * @brief Connects to a running server, receives its state and attaches the
+ *        table region.
+ * Does not serve anything yet: call handoff_confirm() once the table has
+ * been set up over the region.
+ *
+ * @return 0 on success, -1 if no server answered or it refused.
+ */
+int handoff_receive(struct Handoff *h);
+
+/**
+ * @brief Tells the old server this process is ready and waits for it to
+ *        stop. Closes the handoff connection either way.
+ * @return 0 if the old server committed and this process should serve,
+ *         -1 if it backed out or went away.
+ */
+int handoff_confirm(struct Handoff *h);
+
+#endif /* HANDOFF_H */
@@ -1,13 +1,17 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "server.h"
 #include "client.h"
+#include "bench.h"
 #include "vegosh.h"
+#include "snapshot.h"
+#include "trace.h"
 #define DEFAULT_IP "127.0.0.1"
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: vegosh <client [ip_address]|server>\n");
+        fprintf(stderr, "Usage: vegosh <client [ip_address]|server [32|64|128] [--hot] [--trace N]|takeover [--trace N]|bench [32|64|128]>\n");
         return 1;
     }
 
@@ -20,14 +24,71 @@ int main(int argc, char *argv[]) {
         }
         printf("Client disconnected.\n");
     } else if (strcmp(argv[1], "server") == 0) {
+        size_t slot_size   = VEGOSH_DEFAULT_SLOT_SIZE;
+        int    hot_restart = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--hot") == 0)
+                hot_restart = 1;
+            else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+                trace_init(strtoul(argv[++i], NULL, 10));
+            else
+                slot_size = strtoul(argv[i], NULL, 10);
+        }
         printf("Starting server on port 8080...\n");
-        initializevegosh();
+        if (initializevegosh(slot_size, hot_restart) == -1) {
+            fprintf(stderr, "initializevegosh failed\n");
+            return 1;
+        }
+        long restored = snapshot_load(SNAPSHOT_PATH);
+        if (restored == -1) {
+            fprintf(stderr, "snapshot_load failed\n");
+            return 1;
+        }
+        if (restored > 0)
+            printf("Restored %ld keys from %s\n", restored, SNAPSHOT_PATH);
         printf("DB initialized. Waiting for connections...\n");
-        if (startServer() == -1) {
+        if (startServer(hot_restart) == -1) {
             fprintf(stderr, "startServer failed\n");
             return 1;
         }
-        printf("Server shutting down.\n");
+        printf("Server handed off. Shutting down.\n");
+    } else if (strcmp(argv[1], "takeover") == 0) {
+        struct Handoff h;
+        int      trace_set   = 0;
+        uint32_t trace_every = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+                trace_set   = 1;
+                trace_every = strtoul(argv[++i], NULL, 10);
+            }
+        }
+        printf("Taking over from the running server...\n");
+        if (handoff_receive(&h) == -1) {
+            fprintf(stderr, "handoff_receive failed\n");
+            return 1;
+        }
+        /* Keep sampling at the old server's rate unless told otherwise. */
+        trace_init(trace_set ? trace_every : h.trace_every);
+        /* Exiting before handoff_confirm() leaves the old server running. */
+        if (initializevegosh(h.slot_size, 1) == -1) {
+            fprintf(stderr, "initializevegosh failed\n");
+            return 1;
+        }
+        if (handoff_confirm(&h) == -1)
+            return 1;
+        printf("DB attached. Serving...\n");
+        if (resumeServer(&h) == -1) {
+            fprintf(stderr, "resumeServer failed\n");
+            return 1;
+        }
+        printf("Server handed off. Shutting down.\n");
+    } else if (strcmp(argv[1], "bench") == 0) {
+        size_t slot_size = (argc >= 3) ? strtoul(argv[2], NULL, 10)
+                                       : VEGOSH_DEFAULT_SLOT_SIZE;
+        if (startBench(slot_size) == -1) {
+            fprintf(stderr, "startBench failed\n");
+            return 1;
+        }
     } else {
         fprintf(stderr, "Invalid command\n");
         return 1;
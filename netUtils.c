@@ -45,3 +45,37 @@ ssize_t writen(int fd, const void *buf, size_t n) {
   }
   return n;
 }
+
+/**
+ * writevn — writev() counterpart of writen(): gathers all of @p iov in as
+ * few syscalls as the kernel allows, advancing the vector in place on
+ * partial writes.
+ */
+ssize_t writevn(int fd, struct iovec *iov, int iovcnt) {
+  size_t total = 0;
+  ssize_t nwritten;
+
+  for (int i = 0; i < iovcnt; i++)
+    total += iov[i].iov_len;
+
+  size_t nleft = total;
+  while (nleft > 0) {
+    if ((nwritten = writev(fd, iov, iovcnt)) <= 0) {
+      if (nwritten < 0 && errno == EINTR)
+        nwritten = 0;
+      else
+        return -1;
+    }
+    nleft -= nwritten;
+    while (iovcnt > 0 && (size_t)nwritten >= iov->iov_len) {
+      nwritten -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + nwritten;
+      iov->iov_len -= nwritten;
+    }
+  }
+  return total;
+}
@@ -9,84 +9,326 @@
 #include "netUtils.h"
 #include "vegosh.h"
 #include "protocol.h"
+#include "snapshot.h"
+#include "trace.h"
+#include "track.h"
 /**
- * @brief Reads key_len and val_len from the socket, then reads
+ * @brief Reads key_len and the 2-byte val_len from the socket, then reads
  * exactly that many bytes for key and value respectively.
  * Calls insert() and sends back the appropriate status byte.
  */
 int handle_insert(int connfd) {
-    uint8_t key_len, val_len;
+    uint8_t  key_len;
+    uint16_t val_len;
     readn(connfd, &key_len, 1);
-    readn(connfd, &val_len, 1);
+    readn(connfd, &val_len, 2);
+    val_len = ntohs(val_len);
 
-    if (key_len > 16 || val_len > 32) {
+    if (key_len > vegosh_key_size() || val_len > VEGOSH_MAX_VALUE_LEN) {
         uint8_t response = INVALID_OPCODE;
         writen(connfd, &response, 1);
         return -1;
     }
 
-    uint8_t key[16]   = {0};
-    uint8_t value[32] = {0};
+    /* Only the inline width needs zero padding; longer values are read
+     * in full and copied to the arena by length. */
+    uint8_t key[VEGOSH_MAX_KEY_SIZE] = {0};
+    uint8_t value[VEGOSH_MAX_VALUE_LEN];
+    memset(value, 0, VEGOSH_MAX_VALUE_SIZE);
     readn(connfd, key, key_len);
     readn(connfd, value, val_len);
+    trace_stamp(TRACE_READ);
 
     int result = insert(key, value, &val_len);
+    trace_stamp(TRACE_TABLE);
     uint8_t response;
     if      (result ==  0) response = SUCCESS;
     else if (result ==  1) response = KEY_EXISTS_UPDATED;
     else if (result == -1) response = KEY_NOT_FOUND;
     else if (result == -2) response = MAX_KEY_LIMIT_REACHED;
+    else if (result == -3) response = TABLE_FROZEN;
+    else if (result == -5) response = ARENA_FULL;
     else                   response = INVALID_OPCODE;
     writen(connfd, &response, 1);
+    trace_stamp(TRACE_WRITE);
     return 0;
 }
 /**
  * @brief Reads key_len from the socket, then reads exactly that
  * many bytes for the key. Sends back a status byte, followed by
- * the value if found.
+ * the 4-byte version, the 2-byte value length and the value if found.
+ *
+ * The hit reply is a single writev() whose value segment points straight
+ * at the slot or arena bytes, so the value is never copied in user space.
  */
 int handle_get(int connfd) {
     uint8_t key_len;
     readn(connfd, &key_len, 1);
 
-    if (key_len > 16) {
+    if (key_len > vegosh_key_size()) {
         uint8_t response = INVALID_OPCODE;
         writen(connfd, &response, 1);
         return -1;
     }
 
-    uint8_t key[16] = {0};
+    uint8_t key[VEGOSH_MAX_KEY_SIZE] = {0};
     readn(connfd, key, key_len);
+    trace_stamp(TRACE_READ);
 
-    uint8_t value_len = 0;
-    uint8_t out_value[32];
-    int result = get(key, out_value, &value_len);
+    uint16_t value_len = 0;
+    uint32_t version   = 0;
+    const uint8_t *value;
+    int result = get_ref(key, &value, &value_len, &version);
+    trace_stamp(TRACE_TABLE);
     if (result == -1) {
         uint8_t response = KEY_NOT_FOUND;
         writen(connfd, &response, 1);
+        trace_stamp(TRACE_WRITE);
         return 0;
     }
+    uint8_t header[7] = { SUCCESS, version >> 24, version >> 16, version >> 8,
+                          version & 0xFF, value_len >> 8, value_len & 0xFF };
+    struct iovec iov[2] = {
+        { .iov_base = header,          .iov_len = sizeof(header) },
+        { .iov_base = (void *)value,   .iov_len = value_len      },
+    };
+    writevn(connfd, iov, 2);
+    trace_stamp(TRACE_WRITE);
+    return 0;
+}
+/**
+ * @brief Reads key_len, the 2-byte val_len and the 4-byte expected
+ * version, then the key and value. Calls cas() and replies with a status
+ * byte, followed by a 4-byte version for SUCCESS and VERSION_CONFLICT.
+ */
+int handle_cas(int connfd) {
+    uint8_t  key_len;
+    uint16_t val_len;
+    uint32_t expected;
+    readn(connfd, &key_len, 1);
+    readn(connfd, &val_len, 2);
+    readn(connfd, &expected, 4);
+    val_len  = ntohs(val_len);
+    expected = ntohl(expected);
+
+    if (key_len > vegosh_key_size() || val_len > VEGOSH_MAX_VALUE_LEN) {
+        uint8_t response = INVALID_OPCODE;
+        writen(connfd, &response, 1);
+        return -1;
+    }
+
+    uint8_t key[VEGOSH_MAX_KEY_SIZE] = {0};
+    uint8_t value[VEGOSH_MAX_VALUE_LEN];
+    memset(value, 0, VEGOSH_MAX_VALUE_SIZE);
+    readn(connfd, key, key_len);
+    readn(connfd, value, val_len);
+    trace_stamp(TRACE_READ);
+
+    uint32_t version = 0;
+    int result = cas(key, value, &val_len, expected, &version);
+    trace_stamp(TRACE_TABLE);
+    uint8_t response[5] = { 0, version >> 24, version >> 16, version >> 8,
+                            version & 0xFF };
+    if      (result >=  0) response[0] = SUCCESS;
+    else if (result == -4) response[0] = VERSION_CONFLICT;
+    else if (result == -2) response[0] = MAX_KEY_LIMIT_REACHED;
+    else if (result == -3) response[0] = TABLE_FROZEN;
+    else if (result == -5) response[0] = ARENA_FULL;
+    else                   response[0] = INVALID_OPCODE;
+    writen(connfd, response, (result >= 0 || result == -4) ? 5 : 1);
+    trace_stamp(TRACE_WRITE);
+    return 0;
+}
+/**
+ * @brief Reads the on/off byte, switches key tracking for this connection
+ * and replies with its status byte.
+ */
+int handle_tracking(int connfd) {
+    uint8_t on;
+    readn(connfd, &on, 1);
+    track_enable(on != 0);
     uint8_t response = SUCCESS;
     writen(connfd, &response, 1);
-    writen(connfd, &value_len, 1);
-    writen(connfd, out_value, value_len);
+    return 0;
+}
+/**
+ * @brief Starts a background snapshot and replies with its status byte.
+ */
+int handle_snapshot(int connfd) {
+    int result = snapshot_start(SNAPSHOT_PATH);
+    uint8_t response;
+    if      (result == 0) response = SUCCESS;
+    else if (result == 1) response = SNAPSHOT_IN_PROGRESS;
+    else                  response = INVALID_OPCODE;
+    writen(connfd, &response, 1);
+    return 0;
+}
+/**
+ * @brief Freezes the table and replies with its status byte.
+ */
+int handle_freeze(int connfd) {
+    uint8_t response;
+    if (snapshot_running())
+        response = SNAPSHOT_IN_PROGRESS; /* freeze releases pages the dump reads */
+    else
+        response = (vegosh_freeze() == -1) ? INVALID_OPCODE : SUCCESS;
+    writen(connfd, &response, 1);
+    return 0;
+}
+/**
+ * @brief Thaws the table and replies with its status byte.
+ */
+int handle_thaw(int connfd) {
+    uint8_t response = (vegosh_thaw() == -1) ? INVALID_OPCODE : SUCCESS;
+    writen(connfd, &response, 1);
+    return 0;
+}
+/** Records gathered per writev() while streaming a SCAN batch. */
+#define SCAN_IOV_RECORDS 64
+
+/**
+ * @brief Output state of a SCAN reply. Records are queued as iovecs that
+ * point straight at the key and value bytes and flushed every
+ * SCAN_IOV_RECORDS, so a batch needs no buffer proportional to its size.
+ * The reply header rides along with the first flush and the trailer with
+ * the last, so a small batch is a single writev().
+ */
+struct ScanReply {
+    int          connfd;
+    size_t       key_size;
+    int          started; /* iov[0], the reply header, has been sent */
+    int          queued;
+    uint8_t      head[2]; /* [SUCCESS][key_size] */
+    uint8_t      tail[5]; /* [0][next cursor:4] */
+    uint8_t      header[SCAN_IOV_RECORDS][3];
+    struct iovec iov[1 + SCAN_IOV_RECORDS * 3 + 1];
+};
+
+/** Writes out the queued records, and the trailer if @p last. */
+static void scan_flush(struct ScanReply *r, int last) {
+    int first = r->started;
+    int n     = 1 + r->queued * 3;
+    if (last)
+        r->iov[n++] = (struct iovec){ .iov_base = r->tail, .iov_len = sizeof(r->tail) };
+    writevn(r->connfd, r->iov + first, n - first);
+    r->started = 1;
+    r->queued  = 0;
+}
+
+/** vegosh_scan() callback: queues one [1][val_len:2][key][value] record. */
+static void scan_record(const uint8_t *key, const uint8_t *value,
+                        uint16_t value_len, uint32_t version, void *ctx) {
+    struct ScanReply *r = ctx;
+    (void)version;
+    uint8_t      *h   = r->header[r->queued];
+    struct iovec *iov = &r->iov[1 + r->queued * 3];
+
+    h[0] = 1;
+    h[1] = value_len >> 8;
+    h[2] = value_len & 0xFF;
+    iov[0] = (struct iovec){ .iov_base = h,             .iov_len = 3           };
+    iov[1] = (struct iovec){ .iov_base = (void *)key,   .iov_len = r->key_size };
+    iov[2] = (struct iovec){ .iov_base = (void *)value, .iov_len = value_len   };
+
+    if (++r->queued == SCAN_IOV_RECORDS)
+        scan_flush(r, 0);
+}
+/**
+ * @brief Reads the 2-byte count and 4-byte cursor, then streams one batch
+ * of entries followed by the cursor to resume from.
+ */
+int handle_scan(int connfd) {
+    uint16_t count;
+    uint32_t cursor;
+    readn(connfd, &count, 2);
+    readn(connfd, &cursor, 4);
+    count  = ntohs(count);
+    cursor = ntohl(cursor);
+
+    if (count == 0 || count > SCAN_MAX_COUNT)
+        count = SCAN_MAX_COUNT;
+
+    static struct ScanReply reply;
+    reply.connfd   = connfd;
+    reply.key_size = vegosh_key_size();
+    reply.started  = 0;
+    reply.queued   = 0;
+    reply.head[0]  = SUCCESS;
+    reply.head[1]  = (uint8_t)reply.key_size;
+    reply.iov[0]   = (struct iovec){ .iov_base = reply.head, .iov_len = 2 };
+
+    /* A rejected cursor fails before any entry is visited. */
+    uint32_t next;
+    if (vegosh_scan(cursor, count, scan_record, &reply, &next) == -1) {
+        uint8_t response = CURSOR_INVALID;
+        writen(connfd, &response, 1);
+        return 0;
+    }
+
+    reply.tail[0] = 0;
+    reply.tail[1] = next >> 24;
+    reply.tail[2] = next >> 16;
+    reply.tail[3] = next >> 8;
+    reply.tail[4] = next & 0xFF;
+    scan_flush(&reply, 1);
+    return 0;
+}
+/**
+ * @brief Replies with the sampled trace ring as text.
+ *
+ * Formatting happens here, on the server thread, which is fine for a
+ * debugging command; the ring itself is never locked.
+ */
+int handle_trace(int connfd) {
+    static char text[TRACE_RING_SIZE * 64];
+    uint32_t len = (uint32_t)trace_dump(text, sizeof(text));
+    uint8_t header[5] = { SUCCESS, len >> 24, len >> 16, len >> 8, len & 0xFF };
+    struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = sizeof(header) },
+        { .iov_base = text,   .iov_len = len            },
+    };
+    writevn(connfd, iov, 2);
     return 0;
 }
 /**
  * @brief Reads the opcode byte from the socket and dispatches
  * to the appropriate handler.
  *
- * SET --> 0x01
- * GET --> 0x02
+ * SET      --> 0x01
+ * GET      --> 0x02
+ * SNAPSHOT --> 0x03
+ * FREEZE   --> 0x04
+ * THAW     --> 0x05
+ * TRACE    --> 0x06
+ * SCAN     --> 0x07
+ * CAS      --> 0x08
+ * TRACKING --> 0x09
+ *
+ * Every request fires the request__start/request__end USDT probes and is
+ * a candidate for the sampled tracer (trace.h). Timing starts once the
+ * opcode has arrived, so idle time between requests is not counted.
  */
 int parser(int connfd) {
     uint8_t opcode;
+    int rc;
     readn(connfd, &opcode, 1);
+    trace_begin();
+    VEGOSH_PROBE1(request__start, opcode);
     switch (opcode) {
-        case 0x01: return handle_insert(connfd);
-        case 0x02: return handle_get(connfd);
+        case 0x01: rc = handle_insert(connfd);   break;
+        case 0x02: rc = handle_get(connfd);      break;
+        case 0x03: rc = handle_snapshot(connfd); break;
+        case 0x04: rc = handle_freeze(connfd);   break;
+        case 0x05: rc = handle_thaw(connfd);     break;
+        case 0x06: rc = handle_trace(connfd);    break;
+        case 0x07: rc = handle_scan(connfd);     break;
+        case 0x08: rc = handle_cas(connfd);      break;
+        case 0x09: rc = handle_tracking(connfd); break;
         default:
             fprintf(stderr, "Invalid opcode: 0x%02x\n", opcode);
-            return -1;
+            rc = -1;
     }
+    VEGOSH_PROBE2(request__end, opcode, rc);
+    trace_end(opcode);
+    return rc;
 }
@@ -3,11 +3,24 @@
  * @brief Protocol for the Vegosh key-value store.
  *
  * Wire format:
- *   [1 byte opcode] [1 byte key_len] [1 byte val_len] [key_len bytes key] [val_len bytes value]
+ *   [1 byte opcode] [1 byte key_len] [2 byte val_len] [key_len bytes key] [val_len bytes value]
+ *
+ * Multi-byte lengths are in network byte order. val_len may be up to
+ * VEGOSH_MAX_VALUE_LEN; values wider than the table's inline field are
+ * stored in the value arena.
  *
  * Opcodes:
  *   0x01 - SET
  *   0x02 - GET
+ *   0x03 - SNAPSHOT  (no operands; dumps the table to disk in the background)
+ *   0x04 - FREEZE    (no operands; compacts the table into a read-only index)
+ *   0x05 - THAW      (no operands; makes the table writable again)
+ *   0x06 - TRACE     (no operands; replies [SUCCESS][4 byte len][len bytes
+ *                     of text] with the sampled request timings, see trace.h)
+ *   0x07 - SCAN      ([count:2][cursor:4]; see handle_scan())
+ *   0x08 - CAS       ([key_len][val_len:2][expected version:4][key][value];
+ *                     see handle_cas())
+ *   0x09 - TRACKING  ([on:1]; flush pushes on hot restart, see track.h)
  *
  * Status codes:
  *   69 (SUCCESS)              - Operation completed successfully
@@ -15,6 +28,19 @@
  *   68 (KEY_EXISTS_UPDATED)   - Key already existed, value was overwritten
  *   66 (MAX_KEY_LIMIT_REACHED)- Store is full, insertion rejected
  *   65 (DATA_CORRUPTION)      - CRC32 check failed
+ *   64 (INVALID_OPCODE)       - Malformed or oversized request
+ *   63 (SNAPSHOT_IN_PROGRESS) - A previous SNAPSHOT has not finished yet
+ *   62 (TABLE_FROZEN)         - SET rejected because the table is frozen
+ *   61 (CURSOR_INVALID)       - SCAN cursor is out of range or belongs to
+ *                               another frozen index or to the live table
+ *                               while frozen; restart the scan from 0
+ *   60 (VERSION_CONFLICT)     - CAS rejected: the key's version has moved
+ *   58 (ARENA_FULL)           - SET/CAS rejected: the value arena's size
+ *                               class for this value length is exhausted
+ *
+ * Pushes (only on connections with TRACKING on, before any reply byte):
+ *   59 (INVALIDATE)           - drop every cached key; sent once after a
+ *                               hot restart
  */
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
@@ -25,13 +51,21 @@
 #define MAX_KEY_LIMIT_REACHED 66
 #define DATA_CORRUPTION       65
 #define INVALID_OPCODE        64
+#define SNAPSHOT_IN_PROGRESS  63
+#define TABLE_FROZEN          62
+#define CURSOR_INVALID        61
+#define VERSION_CONFLICT      60
+#define INVALIDATE            59
+#define ARENA_FULL            58
 
-int initializevegosh(void);
+/** Largest batch a single SCAN returns; larger or zero counts are clamped. */
+#define SCAN_MAX_COUNT        256
 
 /**
  * @brief Handles a SET request.
  *
- * Reads key_len, val_len, then exactly that many bytes for key and value.
+ * Reads key_len, the 2-byte val_len, then exactly that many bytes for key
+ * and value.
  * Calls insert() and writes a single status byte back to the client.
  *
  * @param connfd File descriptor of the client connection.
@@ -43,7 +77,8 @@ int handle_insert(int connfd);
  * @brief Handles a GET request.
  *
  * Reads key_len, then exactly that many bytes for the key.
- * On success, writes [SUCCESS][value_len][value] back to the client.
+ * On success, writes [SUCCESS][4 byte version][2 byte value_len][value]
+ * back to the client.
  * On failure, writes [KEY_NOT_FOUND].
  *
  * @param connfd File descriptor of the client connection.
@@ -51,6 +86,94 @@ int handle_insert(int connfd);
  */
 int handle_get(int connfd);
 
+/**
+ * @brief Handles a CAS (compare-and-swap) request.
+ *
+ * Reads key_len, the 2-byte val_len and the 4-byte expected version (0 to
+ * create only if absent), then the key and value. The write happens only
+ * if the key's version still matches, decided and applied in one probe.
+ * Replies [SUCCESS][4 byte new version] or [VERSION_CONFLICT][4 byte
+ * current version, 0 if absent]; otherwise a single status byte as for SET.
+ *
+ * @param connfd File descriptor of the client connection.
+ * @return 0 on success, -1 on error.
+ */
+int handle_cas(int connfd);
+
+/**
+ * @brief Handles a TRACKING request.
+ *
+ * Reads one byte: non-zero turns key tracking on for this connection, 0
+ * turns it off. While it is on, a hot restart that inherits the connection
+ * pushes an INVALIDATE first (track.h). Always replies SUCCESS.
+ *
+ * @param connfd File descriptor of the client connection.
+ * @return 0 on success, -1 on error.
+ */
+int handle_tracking(int connfd);
+
+/**
+ * @brief Handles a SNAPSHOT request.
+ *
+ * Forks a background writer for SNAPSHOT_PATH and replies at once with
+ * SUCCESS, or SNAPSHOT_IN_PROGRESS if the previous dump is still running.
+ * The reply does not wait for the dump to reach disk.
+ *
+ * @param connfd File descriptor of the client connection.
+ * @return 0 on success, -1 on error.
+ */
+int handle_snapshot(int connfd);
+
+/**
+ * @brief Handles a FREEZE request.
+ *
+ * Compacts the table into its read-only index. Replies SUCCESS (also when
+ * already frozen), SNAPSHOT_IN_PROGRESS while a dump is running, or
+ * INVALID_OPCODE if the index could not be built.
+ *
+ * @param connfd File descriptor of the client connection.
+ * @return 0 on success, -1 on error.
+ */
+int handle_freeze(int connfd);
+
+/**
+ * @brief Handles a THAW request.
+ *
+ * Rebuilds the writable table. Replies SUCCESS (also when not frozen) or
+ * INVALID_OPCODE if allocation failed.
+ *
+ * @param connfd File descriptor of the client connection.
+ * @return 0 on success, -1 on error.
+ */
+int handle_thaw(int connfd);
+
+/**
+ * @brief Handles a SCAN request.
+ *
+ * Reads a 2-byte count and a 4-byte cursor (0 to start). On success,
+ * writes [SUCCESS][key_size:1], then one [1][val_len:2][key][value] record
+ * per entry in the batch (keys are key_size bytes, zero padded), then
+ * [0][next cursor:4]. A next cursor of 0 means the scan is complete.
+ * Every key present for the whole scan is returned at least once; see
+ * vegosh_scan(). On a stale cursor, writes [CURSOR_INVALID].
+ *
+ * @param connfd File descriptor of the client connection.
+ * @return 0 on success, -1 on error.
+ */
+int handle_scan(int connfd);
+
+/**
+ * @brief Handles a TRACE request.
+ *
+ * Replies [SUCCESS][4 byte text_len][text] with the contents of the sampled
+ * trace ring, one request per line. The text is just a header line when
+ * the server was started without --trace.
+ *
+ * @param connfd File descriptor of the client connection.
+ * @return 0 on success, -1 on error.
+ */
+int handle_trace(int connfd);
+
 /**
  * @brief Reads the opcode byte and dispatches to handle_insert or handle_get.
  *
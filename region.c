@@ -0,0 +1,209 @@
+/**
+ * region.c
+ * brief Anonymous or memfd-backed bump region for all table state.
+ */
+
+#define _GNU_SOURCE
+#include "region.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Bits of a /proc/self/pagemap entry (see Documentation/admin-guide/mm/pagemap.rst). */
+#define PAGEMAP_PRESENT   (1ull << 63)
+#define PAGEMAP_SWAP      (1ull << 62)
+#define PAGEMAP_FILE      (1ull << 61) /* file page or shared anon: not COW'd */
+
+static uint8_t *base         = NULL;
+static size_t   size         = 0;
+static size_t   used         = 0;
+static int      memfd        = -1;
+static int      attached     = 0;
+static int      private_mode = 0;
+static size_t   merge_next   = 0;  /* first page not yet merged back */
+static int      pagemap      = -1; /* open while merging */
+
+/** Rounds @p n up to a multiple of @p align. */
+static inline size_t round_up(size_t n, size_t align) {
+    return (n + align - 1) / align * align;
+}
+
+int region_init(size_t bytes, int shared) {
+    size = round_up(bytes, (size_t)sysconf(_SC_PAGESIZE));
+
+    if (shared) {
+        memfd = memfd_create("vegosh", MFD_CLOEXEC);
+        if (memfd == -1 || ftruncate(memfd, size) == -1) {
+            perror("memfd_create");
+            return -1;
+        }
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    } else {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+
+    if (base == MAP_FAILED) {
+        perror("mmap region");
+        base = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int region_attach(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat region");
+        return -1;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap region");
+        base = NULL;
+        return -1;
+    }
+
+    size     = st.st_size;
+    memfd    = fd;
+    attached = 1;
+    return 0;
+}
+
+void *region_alloc(size_t bytes, size_t align) {
+    size_t offset = round_up(used, align);
+    if (!base || offset + bytes > size)
+        return NULL;
+    used = offset + bytes;
+    return base + offset;
+}
+
+int region_attached(void) {
+    return attached;
+}
+
+int region_fd(void) {
+    return memfd;
+}
+
+size_t region_size(void) {
+    return size;
+}
+
+void region_release(void *addr, size_t len) {
+    if (private_mode) {
+        /* Dropping a private COW page would resurrect the memfd copy. */
+        memset(addr, 0, len);
+        return;
+    }
+
+    /* madvise() only takes whole pages; zero the partial ones at the edges. */
+    uintptr_t page  = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)addr;
+    uintptr_t end   = start + len;
+    uintptr_t first = (start + page - 1) & ~(page - 1);
+    uintptr_t last  = end & ~(page - 1);
+
+    if (first >= last) {
+        memset(addr, 0, len);
+        return;
+    }
+    memset(addr, 0, first - start);
+    memset((void *)last, 0, end - last);
+    if (madvise((void *)first, last - first,
+                memfd != -1 ? MADV_REMOVE : MADV_DONTNEED) == -1) {
+        perror("madvise");
+        memset((void *)first, 0, last - first);
+    }
+}
+
+int region_begin_private(void) {
+    if (memfd == -1 || private_mode)
+        return 0;
+
+    void *p = mmap(base, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_FIXED | MAP_NORESERVE, memfd, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap private");
+        return -1;
+    }
+    private_mode = 1;
+    return 0;
+}
+
+int region_private(void) {
+    return private_mode;
+}
+
+int region_merge_step(void) {
+    if (!private_mode)
+        return 0;
+
+    size_t page   = (size_t)sysconf(_SC_PAGESIZE);
+    size_t npages = size / page;
+    size_t n      = npages - merge_next < REGION_MERGE_SCAN
+                  ? npages - merge_next : REGION_MERGE_SCAN;
+    if (pagemap == -1 &&
+        (pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC)) == -1) {
+        perror("open pagemap");
+        return -1;
+    }
+
+    static uint64_t entries[REGION_MERGE_SCAN];
+    off_t first = (off_t)((uintptr_t)base / page + merge_next);
+    if (pread(pagemap, entries, n * 8, first * 8) != (ssize_t)(n * 8)) {
+        perror("pread pagemap");
+        return -1;
+    }
+
+    /* Most of a large region is never touched, so the chunk extends until it
+     * holds REGION_MERGE_PAGES mapped pages. A page the parent wrote to since
+     * begin_private() has been COW'd into anonymous memory: present or
+     * swapped out, but no longer a file page. */
+    size_t j, mapped = 0;
+    for (j = 0; j < n && mapped < REGION_MERGE_PAGES; j++) {
+        if (!(entries[j] & (PAGEMAP_PRESENT | PAGEMAP_SWAP)))
+            continue;
+        mapped++;
+        if (!(entries[j] & PAGEMAP_FILE)) {
+            off_t off = (off_t)(merge_next + j) * page;
+            if (pwrite(memfd, base + off, page, off) != (ssize_t)page) {
+                perror("pwrite region");
+                return -1;
+            }
+        }
+    }
+    n = j;
+
+    /* Share this chunk again before returning, so no later write can land
+     * in a private page that has already been merged. The kernel joins the
+     * chunk onto the shared mapping before it into a single VMA. */
+    off_t off = (off_t)merge_next * page;
+    void *p   = mmap(base + off, n * page, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_FIXED, memfd, off);
+    if (p == MAP_FAILED) {
+        perror("mmap shared");
+        return -1;
+    }
+
+    merge_next += n;
+    if (merge_next < npages)
+        return 1;
+    private_mode = 0;
+    merge_next   = 0;
+    close(pagemap);
+    pagemap = -1;
+    return 0;
+}
+
+int region_end_private(void) {
+    int rc;
+    while ((rc = region_merge_step()) == 1)
+        ;
+    return rc;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file region.h
+ * @brief The single mapping that backs every table and arena byte.
+ *
+ * All long-lived state – slot arrays, key counts, arena blocks and free
+ * stacks – is bump-allocated from one region at startup, in a fixed order.
+ * That makes the layout a pure function of the variant, so a second
+ * process that maps the same memory and repeats the same allocations finds
+ * every structure exactly where the first one left it.
+ *
+ * By default the region is anonymous private memory. In hot-restart mode
+ * it is a memfd mapped MAP_SHARED, which can be handed to a new process
+ * over a Unix socket (see handoff.h) without copying a byte.
+ *
+ * Fresh regions are zero-filled by the kernel, so nothing needs memset()
+ * and pages are only faulted in when first touched.
+ */
+
+#ifndef REGION_H
+#define REGION_H
+
+#include <stddef.h>
+
+/**
+ * @brief Maps a new zero-filled region of at least @p size bytes.
+ * @param shared Non-zero to back it with a memfd (hot-restart mode).
+ * @return 0 on success, -1 on failure.
+ */
+int region_init(size_t size, int shared);
+
+/**
+ * @brief Maps the memfd @p fd received from a previous process.
+ *
+ * Subsequent region_alloc() calls return the existing structures, and
+ * region_attached() tells their owners not to reinitialise them.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int region_attach(int fd);
+
+/**
+ * @brief Bump-allocates @p size bytes aligned to @p align.
+ * @return Pointer into the region, or NULL if it is exhausted.
+ */
+void *region_alloc(size_t size, size_t align);
+
+/** @brief Non-zero if the region was inherited through region_attach(). */
+int region_attached(void);
+
+/** @brief The backing memfd, or -1 for an anonymous region. */
+int region_fd(void);
+
+/** @brief Size in bytes of the mapping. */
+size_t region_size(void);
+
+/**
+ * @brief Returns the pages of [@p addr, @p addr + @p len) to the kernel.
+ * They read back as zeroes.
+ */
+void region_release(void *addr, size_t len);
+
+/**
+ * @brief Remaps a shared region copy-on-write for this process only.
+ *
+ * Called in the parent after forking a snapshot child: the parent's writes
+ * stop reaching the memfd, so the child's MAP_SHARED view stays frozen at
+ * the fork instant just as anonymous memory would. No-op for anonymous
+ * regions.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int region_begin_private(void);
+
+/**
+ * Mapped pages region_merge_step() merges per call: at most 256 KB of
+ * pwrite()s plus one mmap(), ~40 us on average on the request path.
+ */
+#define REGION_MERGE_PAGES 64
+
+/** Most pagemap entries (pages) region_merge_step() reads per call. */
+#define REGION_MERGE_SCAN 4096
+
+/**
+ * @brief Writes the dirty pages of the next chunk back to the memfd and
+ * maps that chunk shared again.
+ *
+ * A chunk ends after REGION_MERGE_PAGES mapped pages or REGION_MERGE_SCAN
+ * pages in all, so the untouched bulk of the arena reservation costs one
+ * pagemap read per 16 MB.
+ *
+ * Pages the parent wrote since region_begin_private() are found through
+ * /proc/self/pagemap. Every page of the region is checked, so merging a
+ * whole region costs one pagemap entry per page plus one pwrite() per dirty
+ * page, and each page refaults on its next access. On a 170 MB region
+ * (1M keys) written to during the dump that is ~25 ms, which merging in one
+ * go charged to a single request; calling this between requests spreads it
+ * out instead. The region stays private, and region_private() non-zero,
+ * until the last chunk is merged.
+ *
+ * @return 1 if chunks remain, 0 once the region is shared again (or was
+ *         never private), -1 on failure, after which the region stays
+ *         private and the call may be retried.
+ */
+int region_merge_step(void);
+
+/**
+ * @brief Merges every remaining chunk at once.
+ * @return 0 once the region is shared again, -1 on failure.
+ */
+int region_end_private(void);
+
+/** @brief Non-zero while writes are not reaching the memfd. */
+int region_private(void);
+
+#endif /* REGION_H */
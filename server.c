@@ -1,5 +1,99 @@
+#include <poll.h>
 #include "netUtils.h"
 #include "protocol.h"
+#include "snapshot.h"
+#include "handoff.h"
+#include "track.h"
+
+/**
+ * @brief Blocks until @p fd or @p handoff_fd is readable.
+ *
+ * While a snapshot or its region merge is outstanding it wakes every
+ * millisecond to move that along, so an idle server still finishes it.
+ *
+ * @return 1 if a takeover request is waiting on @p handoff_fd (checked
+ *         first), 0 if @p fd is readable, -1 on error.
+ */
+static int wait_readable(int fd, int handoff_fd) {
+    struct pollfd pfds[2] = {
+        { .fd = fd,         .events = POLLIN },
+        { .fd = handoff_fd, .events = POLLIN },
+    };
+
+    int ready;
+    while ((ready = poll(pfds, 2, snapshot_running() ? 1 : -1)) <= 0) {
+        if (ready == 0)
+            snapshot_reap();
+        else if (errno != EINTR) {
+            perror("poll");
+            return -1;
+        }
+    }
+    return (pfds[1].revents & POLLIN) ? 1 : 0;
+}
+
+/**
+ * @brief Accepts clients on @p listenfd and serves them one at a time.
+ *
+ * If @p connfd is not -1 it is served first (a connection inherited from a
+ * hot restart). If @p handoff_fd is not -1 the server also watches it
+ * between requests; a takeover hands everything to the new process and
+ * makes serve() return 0 so this process can exit.
+ */
+static int serve(int listenfd, int handoff_fd, int connfd) {
+    struct sockaddr_in clientaddr;
+    socklen_t clilen;
+
+    /* Main accept loop: runs for the lifetime of the server. */
+    for (;;) {
+        if (connfd == -1) {
+            if (handoff_fd != -1) {
+                int ready = wait_readable(listenfd, handoff_fd);
+                if (ready == 1 && handoff_send(handoff_fd, listenfd, -1) == 0)
+                    return 0;
+                if (ready != 0)
+                    continue;
+            }
+
+            clilen = sizeof(clientaddr);
+
+            /* Block until a new client connection arrives. */
+            connfd = accept(listenfd, (struct sockaddr *)&clientaddr, &clilen);
+            if (connfd == -1) {
+                perror("Accept Error");
+                continue; /* don't kill the server on a single bad accept */
+            }
+
+            printf("Accepted a new connection\n");
+        }
+
+        /*
+         * Process requests from this client.
+         * parser() handles one protocol command per call and
+         * returns 0 while the connection should remain open.
+         * A finished background snapshot is collected between requests,
+         * and in hot-restart mode a takeover may happen there too.
+         */
+        for (;;) {
+            if (handoff_fd != -1) {
+                int ready = wait_readable(connfd, handoff_fd);
+                if (ready == 1 && handoff_send(handoff_fd, listenfd, connfd) == 0)
+                    return 0;
+                if (ready != 0)
+                    continue;
+            }
+            if (parser(connfd) != 0)
+                break;
+            snapshot_reap();
+        }
+
+        /* Client session finished — close the connected socket. */
+        track_reset();
+        close(connfd);
+        connfd = -1;
+        printf("Connection closed\n");
+    }
+}
 
 /**
  * @brief Initializes a TCP server on port 8080 and handles clients sequentially.
@@ -11,13 +105,15 @@
  *   - Accepts clients in a loop
  *   - For each connection, repeatedly calls parser() until the client disconnects
  *
+ * With @p hot_restart set it also listens for takeover requests (handoff.h).
+ * That costs one poll() per request, which is why it is opt-in.
+ *
  * Note:
  *   This is a single-threaded, iterative server (one client handled at a time).
  */
-int startServer() {
-    int connfd, listenfd;
-    struct sockaddr_in clientaddr, servaddr;
-    socklen_t clilen;
+int startServer(int hot_restart) {
+    int listenfd;
+    struct sockaddr_in servaddr;
 
     /* Create a TCP socket (IPv4, stream-oriented). */
     listenfd = socket(AF_INET, SOCK_STREAM, 0);
@@ -50,29 +146,25 @@ int startServer() {
         return -1;
     }
 
-    /* Main accept loop: runs for the lifetime of the server. */
-    for (;;) {
-        clilen = sizeof(clientaddr);
-
-        /* Block until a new client connection arrives. */
-        connfd = accept(listenfd, (struct sockaddr *)&clientaddr, &clilen);
-        if (connfd == -1) {
-            perror("Accept Error");
-            continue; /* don't kill the server on a single bad accept */
-        }
+    int handoff_fd = -1;
+    if (hot_restart && (handoff_fd = handoff_listen()) == -1)
+        return -1;
 
-        printf("Accepted a new connection\n");
+    return serve(listenfd, handoff_fd, -1);
+}
 
-        /*
-         * Process requests from this client.
-         * parser() handles one protocol command per call and
-         * returns 0 while the connection should remain open.
-         */
-        while (parser(connfd) == 0)
-            ;
+/**
+ * @brief Continues serving with the sockets received in a takeover.
+ */
+int resumeServer(const struct Handoff *h) {
+    if (h->connfd != -1)
+        printf("Resuming an inherited connection\n");
 
-        /* Client session finished — close the connected socket. */
-        close(connfd);
-        printf("Connection closed\n");
+    /* This process never served the connection, so it cannot vouch for
+     * what the client cached: keep tracking, but have it drop everything. */
+    if (h->connfd != -1 && h->tracking) {
+        track_enable(1);
+        track_flush(h->connfd);
     }
+    return serve(h->listenfd, h->handoff_fd, h->connfd);
 }
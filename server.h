@@ -1,6 +1,9 @@
 #ifndef SERVER_H
 #define SERVER_H
 
-int startServer();
+#include "handoff.h"
+
+int startServer(int hot_restart);
+int resumeServer(const struct Handoff *h);
 
 #endif /* SERVER_H */
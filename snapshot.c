@@ -0,0 +1,290 @@
+/**
+ * snapshot.c
+ * brief fork()-based background snapshots and startup loading.
+ *
+ * The parent never touches the file: it forks, remembers the child's pid,
+ * and reaps it later with waitpid(WNOHANG). The child walks the table with
+ * vegosh_for_each() – every page it reads is the pre-fork version, because
+ * any page the parent writes to afterwards is copied by the kernel first.
+ *
+ * A memfd-backed region (hot-restart mode) is MAP_SHARED, which fork() does
+ * not copy-on-write, so for the duration of the dump the parent remaps it
+ * privately and merges its dirty pages back afterwards, one chunk per
+ * snapshot_reap() call (region.h). A new dump waits for that to finish.
+ */
+
+#define _GNU_SOURCE
+#include "snapshot.h"
+#include "region.h"
+#include "vegosh.h"
+#include <arpa/inet.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static_assert(sizeof(struct SnapshotHeader) == 32,
+              "snapshot header must be exactly 32 bytes");
+
+/** pid of the running snapshot child, or 0 if none is running. */
+static pid_t snapshot_child = 0;
+
+/** Set once merging the region back failed; see snapshot_reap(). */
+static int merge_failed = 0;
+
+/* -------------------------------------------------------------------------
+ * Writing
+ * ---------------------------------------------------------------------- */
+
+/** State threaded through vegosh_for_each() while writing records. */
+struct SnapshotWriter {
+    FILE    *fp;
+    size_t   key_size;
+    uint64_t count;
+    uint32_t crc32;
+    int      failed;
+};
+
+/** Appends one record and folds its bytes into the running CRC. */
+static void write_record(const uint8_t *key, const uint8_t *value,
+                         uint16_t value_len, uint32_t version, void *ctx) {
+    struct SnapshotWriter *w = ctx;
+    uint16_t wire_len     = htons(value_len);
+    uint32_t wire_version = htonl(version);
+
+    if (fwrite(key, 1, w->key_size, w->fp)   != w->key_size ||
+        fwrite(&wire_len, 1, 2, w->fp)       != 2 ||
+        fwrite(&wire_version, 1, 4, w->fp)   != 4 ||
+        fwrite(value, 1, value_len, w->fp)   != value_len) {
+        w->failed = 1;
+        return;
+    }
+
+    w->crc32 = crc32(w->crc32, (const Bytef *)key, w->key_size);
+    w->crc32 = crc32(w->crc32, (const Bytef *)&wire_len, 2);
+    w->crc32 = crc32(w->crc32, (const Bytef *)&wire_version, 4);
+    w->crc32 = crc32(w->crc32, (const Bytef *)value, value_len);
+    w->count++;
+}
+
+int snapshot_write(const char *path) {
+    char tmp_path[256];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        perror("snapshot fopen");
+        return -1;
+    }
+
+    /* Reserve room for the header; it is rewritten once count and CRC
+     * are known. */
+    struct SnapshotHeader header = {0};
+    struct SnapshotWriter w = {
+        .fp       = fp,
+        .key_size = vegosh_key_size(),
+        .crc32    = crc32(0L, Z_NULL, 0),
+    };
+    if (fwrite(&header, sizeof(header), 1, fp) != 1)
+        w.failed = 1;
+
+    if (!w.failed)
+        vegosh_for_each(write_record, &w);
+
+    header.magic     = SNAPSHOT_MAGIC;
+    header.version   = SNAPSHOT_VERSION;
+    header.key_size  = (uint32_t)w.key_size;
+    header.slot_size = (uint32_t)vegosh_slot_size();
+    header.count     = w.count;
+    header.crc32     = w.crc32;
+
+    if (w.failed ||
+        fseek(fp, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fflush(fp) != 0 ||
+        fsync(fileno(fp)) != 0) {
+        perror("snapshot write");
+        fclose(fp);
+        unlink(tmp_path);
+        return -1;
+    }
+    fclose(fp);
+
+    if (rename(tmp_path, path) == -1) {
+        perror("snapshot rename");
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------------
+ * Background snapshots
+ * ---------------------------------------------------------------------- */
+
+int snapshot_start(const char *path) {
+    snapshot_reap();
+    if (snapshot_running())
+        return 1;
+
+    fflush(stdout); /* don't let the child re-emit buffered output */
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        /* Drop inherited sockets so a client the parent closes sees EOF
+         * immediately rather than when the dump finishes. */
+        close_range(3, ~0U, 0);
+        _exit(snapshot_write(path) == 0 ? 0 : 1);
+    }
+
+    if (region_begin_private() == -1) {
+        /* The child would see the parent's writes; don't keep its dump. */
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+    snapshot_child = pid;
+    printf("Snapshot started (pid %d)\n", (int)pid);
+    return 0;
+}
+
+/** Collects the snapshot child, blocking if @p options is 0. */
+static void reap(int options) {
+    if (snapshot_child == 0)
+        return;
+
+    int status;
+    pid_t pid = waitpid(snapshot_child, &status, options);
+    if (pid == 0)
+        return; /* still running */
+
+    if (pid == snapshot_child && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        printf("Snapshot finished\n");
+    else
+        fprintf(stderr, "Snapshot failed\n");
+    snapshot_child = 0;
+}
+
+void snapshot_reap(void) {
+    reap(WNOHANG);
+
+    /* Merge the parent's private pages back a chunk at a time. After a
+     * failure leave it to snapshot_wait() rather than retrying (and
+     * logging) on every request. */
+    if (snapshot_child == 0 && region_private() && !merge_failed &&
+        region_merge_step() == -1) {
+        fprintf(stderr, "Region merge failed; snapshots stay disabled\n");
+        merge_failed = 1;
+    }
+}
+
+int snapshot_wait(void) {
+    reap(0);
+    if (region_end_private() == -1)
+        return -1;
+    merge_failed = 0;
+    return 0;
+}
+
+int snapshot_running(void) {
+    return snapshot_child != 0 || region_private();
+}
+
+/* -------------------------------------------------------------------------
+ * Loading
+ * ---------------------------------------------------------------------- */
+
+/**
+ * Reads one record into @p key / @p value / @p version. Version 1 files
+ * carry no version field; their records read as version 1.
+ * @return 1 on success, 0 at a clean end of file, -1 on a truncated or
+ *         oversized record.
+ */
+static int read_record(FILE *fp, const struct SnapshotHeader *header,
+                       uint8_t *key, uint8_t *value, uint16_t *value_len,
+                       uint32_t *version) {
+    uint16_t wire_len;
+    uint32_t wire_version = htonl(1);
+
+    size_t n = fread(key, 1, header->key_size, fp);
+    if (n == 0 && feof(fp))
+        return 0;
+    if (n != header->key_size || fread(&wire_len, 1, 2, fp) != 2)
+        return -1;
+    if (header->version >= 2 && fread(&wire_version, 1, 4, fp) != 4)
+        return -1;
+
+    *value_len = ntohs(wire_len);
+    *version   = ntohl(wire_version);
+    if (*value_len > VEGOSH_MAX_VALUE_LEN ||
+        fread(value, 1, *value_len, fp) != *value_len)
+        return -1;
+    return 1;
+}
+
+long snapshot_load(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return 0; /* nothing to restore */
+
+    struct SnapshotHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        header.magic != SNAPSHOT_MAGIC ||
+        header.version < 1 || header.version > SNAPSHOT_VERSION ||
+        header.key_size != vegosh_key_size()) {
+        fprintf(stderr, "Snapshot %s: bad header or key width\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    uint8_t  key[VEGOSH_MAX_KEY_SIZE];
+    uint8_t  value[VEGOSH_MAX_VALUE_LEN];
+    uint16_t value_len;
+    uint32_t version;
+    uint64_t records = 0;
+    uint32_t crc = crc32(0L, Z_NULL, 0);
+    int      rc;
+
+    /* Pass 1: verify the checksum before touching the table. */
+    while ((rc = read_record(fp, &header, key, value, &value_len, &version)) == 1) {
+        uint16_t wire_len     = htons(value_len);
+        uint32_t wire_version = htonl(version);
+        crc = crc32(crc, (const Bytef *)key, header.key_size);
+        crc = crc32(crc, (const Bytef *)&wire_len, 2);
+        if (header.version >= 2)
+            crc = crc32(crc, (const Bytef *)&wire_version, 4);
+        crc = crc32(crc, (const Bytef *)value, value_len);
+        records++;
+    }
+    if (rc == -1 || records != header.count || crc != header.crc32) {
+        fprintf(stderr, "Snapshot %s: checksum mismatch\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    /* Pass 2: insert, keeping each version. The inline part of the value
+     * must be zero padded. */
+    fseek(fp, sizeof(header), SEEK_SET);
+    for (;;) {
+        memset(value, 0, VEGOSH_MAX_VALUE_SIZE);
+        if (read_record(fp, &header, key, value, &value_len, &version) != 1)
+            break;
+        int result = restore(key, value, &value_len, version);
+        if (result == -2 || result == -5) {
+            fprintf(stderr, "Snapshot %s: %s full while loading\n", path,
+                    result == -2 ? "table" : "value arena");
+            fclose(fp);
+            return -1;
+        }
+    }
+
+    fclose(fp);
+    return (long)records;
+}
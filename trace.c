@@ -0,0 +1,88 @@
+/**
+ * trace.c
+ * brief Fixed ring of sampled request timings.
+ *
+ * Everything here runs on the single server thread: requests fill the
+ * record in the slot after the head and then advance it, and trace_dump()
+ * is called by the TRACE handler between those steps. No locking is
+ * needed. When the ring is full the oldest records are overwritten.
+ */
+
+#include "trace.h"
+#include <stdio.h>
+
+struct TraceRecord *trace_current = NULL;
+
+static struct TraceRecord ring[TRACE_RING_SIZE];
+
+/** Number of records ever published; the next one goes at head % size. */
+static uint64_t ring_head = 0;
+
+/** Sampling period (0 = off) and requests left until the next sample. */
+static uint32_t sample_every = 0;
+static uint32_t sample_countdown = 0;
+
+void trace_init(uint32_t every) {
+    sample_every     = every;
+    sample_countdown = every;
+}
+
+void trace_begin(void) {
+    if (sample_every == 0 || --sample_countdown != 0)
+        return;
+    sample_countdown = sample_every;
+
+    trace_current = &ring[ring_head & (TRACE_RING_SIZE - 1)];
+    *trace_current = (struct TraceRecord){0};
+    trace_current->tsc[TRACE_START] = trace_clock();
+}
+
+void trace_end(uint8_t opcode) {
+    if (!trace_current)
+        return;
+    trace_current->opcode = opcode;
+    trace_current = NULL;
+    ring_head++;
+}
+
+uint32_t trace_rate(void) {
+    return sample_every;
+}
+
+/** Cycles from @p from to @p to, or 0 if either stage was not reached. */
+static inline uint64_t span(const struct TraceRecord *r,
+                            enum TraceStage from, enum TraceStage to) {
+    return (r->tsc[from] && r->tsc[to]) ? r->tsc[to] - r->tsc[from] : 0;
+}
+
+size_t trace_dump(char *buf, size_t cap) {
+    uint64_t head  = ring_head;
+    uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    size_t   len   = 0;
+    int      n;
+
+    /* A sampled TRACE request is filling the slot at head, which in a full
+     * ring is also the oldest one: leave its half-written record out. */
+    if (trace_current && head >= TRACE_RING_SIZE)
+        first = head - TRACE_RING_SIZE + 1;
+
+    n = snprintf(buf, cap, "opcode probe_len read table write total\n");
+    if (n < 0 || (size_t)n >= cap)
+        return 0;
+    len = n;
+
+    for (uint64_t i = first; i < head; i++) {
+        const struct TraceRecord *r = &ring[i & (TRACE_RING_SIZE - 1)];
+        n = snprintf(buf + len, cap - len,
+                     "0x%02x %u %llu %llu %llu %llu\n",
+                     r->opcode, r->probe_len,
+                     (unsigned long long)span(r, TRACE_START, TRACE_READ),
+                     (unsigned long long)span(r, TRACE_READ, TRACE_TABLE),
+                     (unsigned long long)span(r, TRACE_TABLE, TRACE_WRITE),
+                     (unsigned long long)span(r, TRACE_START, TRACE_WRITE));
+        if (n < 0 || (size_t)n >= cap - len)
+            break;
+        len += n;
+    }
+    return len;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file trace.h
+ * @brief USDT probes and a sampled per-request stage tracer.
+ *
+ * USDT: when <sys/sdt.h> is available, VEGOSH_PROBEn() emits a static
+ * probe in the "vegosh" provider. A disabled probe is a single nop, so they
+ * stay compiled in; attach with e.g.
+ *
+ *   bpftrace -e 'usdt:./vegosh:vegosh:get { @[arg0] = count(); }'
+ *
+ * Probes:
+ *   request__start(opcode)        – parser() read the opcode
+ *   request__end(opcode, rc)      – handler returned
+ *   insert(probe_len, result)     – Robin Hood placement finished (SET,
+ *                                   and each entry THAW re-places)
+ *   get(probe_len, found)         – lookup finished
+ *   cas(probe_len, -4)            – CAS lost on version (a CAS that writes
+ *                                   fires insert instead)
+ *
+ * Sampled tracer: with trace_init(N), every Nth request records a TSC
+ * timestamp at each stage below into a fixed ring, along with its opcode
+ * and probe length. TRACE (opcode 0x06) dumps the ring. With N = 0 the
+ * cost per request is one predictable branch.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define VEGOSH_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef VEGOSH_HAVE_USDT
+#define VEGOSH_PROBE1(name, a)    DTRACE_PROBE1(vegosh, name, a)
+#define VEGOSH_PROBE2(name, a, b) DTRACE_PROBE2(vegosh, name, a, b)
+#else
+#define VEGOSH_PROBE1(name, a)    do { (void)(a); } while (0)
+#define VEGOSH_PROBE2(name, a, b) do { (void)(a); (void)(b); } while (0)
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/** Records kept by the ring. Must be a power of two. */
+#define TRACE_RING_SIZE 4096
+
+/** Stages timestamped for a sampled request. */
+enum TraceStage {
+    TRACE_START, /* parser() received the opcode */
+    TRACE_READ,  /* request fully read from the socket */
+    TRACE_TABLE, /* hash table operation returned */
+    TRACE_WRITE, /* response written */
+    TRACE_STAGES
+};
+
+/**
+ * @struct TraceRecord
+ * @brief One sampled request.
+ */
+struct TraceRecord {
+    uint64_t tsc[TRACE_STAGES];
+    uint32_t probe_len; /* slots probed by insert()/get() */
+    uint8_t  opcode;
+};
+
+/** Record being filled for the current request; NULL if not sampled. */
+extern struct TraceRecord *trace_current;
+
+/** Reads the timestamp counter (or a ns clock off x86). */
+static inline uint64_t trace_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+/** Timestamps @p stage of the current request if it is being sampled. */
+static inline void trace_stamp(enum TraceStage stage) {
+    if (trace_current)
+        trace_current->tsc[stage] = trace_clock();
+}
+
+/** Notes the probe length of the current request if it is being sampled. */
+static inline void trace_probe_len(size_t probe_len) {
+    if (trace_current)
+        trace_current->probe_len = (uint32_t)probe_len;
+}
+
+/** @brief Samples one request in every @p every (0 disables sampling). */
+void trace_init(uint32_t every);
+
+/** @brief The sampling period set by trace_init(); 0 if off. */
+uint32_t trace_rate(void);
+
+/** @brief Decides whether this request is sampled and stamps TRACE_START. */
+void trace_begin(void);
+
+/** @brief Publishes the current record to the ring. */
+void trace_end(uint8_t opcode);
+
+/**
+ * @brief Formats the ring, oldest first, as text into @p buf.
+ *
+ * One header line, then one line per record: opcode, probe length and the
+ * cycles spent reading, in the table and writing, plus the total.
+ *
+ * @return Number of bytes written (never more than @p cap).
+ */
+size_t trace_dump(char *buf, size_t cap);
+
+#endif /* TRACE_H */
@@ -0,0 +1,27 @@
+/**
+ * track.c
+ * brief Tracking state of the connection being served.
+ */
+
+#include "track.h"
+#include "netUtils.h"
+#include "protocol.h"
+
+static int enabled = 0;
+
+void track_enable(int on) {
+    enabled = on;
+}
+
+int track_enabled(void) {
+    return enabled;
+}
+
+void track_reset(void) {
+    track_enable(0);
+}
+
+void track_flush(int connfd) {
+    uint8_t push = INVALIDATE;
+    writen(connfd, &push, 1);
+}
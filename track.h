@@ -0,0 +1,42 @@
+/**
+ * @file track.h
+ * @brief TRACKING: flush a client's near cache on hot restart.
+ *
+ * A connection that sends TRACKING ON may cache what it reads. The server
+ * handles one connection at a time (server.c), so no other client can
+ * write while it is being served: the only writes that could make its
+ * cache stale are its own, and the client drops those keys itself when it
+ * sends them. The server therefore keeps no per-key state.
+ *
+ * What the client cannot see is a hot restart handing its connection to a
+ * new process. That process flushes the client with a single push, sent
+ * ahead of whatever reply comes next:
+ *
+ *   [INVALIDATE]                      – drop every cached key
+ *
+ * The client handles it wherever it reads a status byte, so a cached value
+ * is never used after the reply that follows it. A server that multiplexed
+ * connections would need per-connection read tracking and per-key pushes;
+ * this one has neither.
+ *
+ * Tracking belongs to the connection being served and is reset when it
+ * closes. Another client's writes can only land while this one is
+ * disconnected, so a client must clear its cache whenever it reconnects.
+ */
+
+#ifndef TRACK_H
+#define TRACK_H
+
+/** @brief Turns tracking on or off for the connection. */
+void track_enable(int on);
+
+/** @brief Non-zero if the current connection has tracking on. */
+int track_enabled(void);
+
+/** @brief Forgets the connection's state; called when it closes. */
+void track_reset(void);
+
+/** @brief Pushes a drop-everything invalidation on @p connfd. */
+void track_flush(int connfd);
+
+#endif /* TRACK_H */
@@ -11,91 +11,253 @@
  *
  * Hash function: XXH3_64bits (lower 32 bits used as the stored hash).
  * Collision resolution: linear probing with Robin Hood displacement.
- * Slot size: 64 bytes (one cache line) enforced by a compile-time assertion.
+ * Slot layout: generated per variant from vegosh_table.h; each variant's
+ * size and cache-line fit are enforced by compile-time assertions.
  */
 
 #include "vegosh.h"
+#include "arena.h"
+#include "region.h"
+#include "trace.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
 
 /* -------------------------------------------------------------------------
- * Global table state
+ * Internal helpers
  * ---------------------------------------------------------------------- */
 
-/** Pointer to the cache-line-aligned array of slots. */
-static struct Slot *vegosh = NULL;
+/**
+ *  Returns the probe distance of slot @p index from its home bucket.
+ *
+ * Because the table wraps, subtraction is done modulo TABLE_SIZE using the
+ * pre-computed MASK.
+ *
+ * @param index  Current slot index.
+ * @param home Home slot index (hash & MASK) for the entry at @p index.
+ * @return Number of steps the entry has been displaced from home.
+ */
+static inline size_t probe_distance(size_t index, size_t home) {
+    return (index + TABLE_SIZE - home) & MASK;
+}
 
-/** Number of unique keys currently stored in the table. */
-static size_t vegosh_count = 0;
+/**
+ * @brief Version that follows @p version. Wraps past 0, which cas() reserves
+ * for "key absent".
+ */
+static inline uint32_t next_version(uint32_t version) {
+    return version + 1 ? version + 1 : 1;
+}
 
-/* -------------------------------------------------------------------------
- * Initialisation
- * ---------------------------------------------------------------------- */
+/** Frozen arrays are rounded up to whole 2 MB transparent huge pages. */
+#define FROZEN_HUGE_PAGE (2u << 20)
+
+/** Rounds @p size up to whole FROZEN_HUGE_PAGE pages. */
+static inline size_t frozen_round(size_t size) {
+    return (size + FROZEN_HUGE_PAGE - 1) & ~(size_t)(FROZEN_HUGE_PAGE - 1);
+}
 
 /**
- * Brief: Allocates and zero-initialises the global hash table.
+ * @brief Maps @p size zero-filled bytes for a frozen array and asks for
+ * transparent huge pages. Random lookups over tens of MB of 4 KB pages take
+ * a TLB miss, and so a page walk, on almost every access; with 2 MB pages
+ * the whole index needs a few dozen TLB entries.
  *
- * Uses aligned_alloc() to guarantee that the base of the array – and
- * therefore every individual 64-byte slot – is cache-line aligned.
+ * @return The mapping, or NULL on failure. Release with frozen_free().
+ */
+static void *frozen_alloc(size_t size) {
+    /* Huge pages need 2 MB-aligned addresses: over-map and trim. */
+    size_t   len = frozen_round(size);
+    uint8_t *raw = mmap(NULL, len + FROZEN_HUGE_PAGE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return NULL;
+
+    uint8_t *p    = (uint8_t *)frozen_round((uintptr_t)raw);
+    size_t   head = (size_t)(p - raw);
+    if (head > 0)
+        munmap(raw, head);
+    munmap(p + len, FROZEN_HUGE_PAGE - head);
+
+    madvise(p, len, MADV_HUGEPAGE); /* advisory only */
+    return p;
+}
+
+/** Unmaps an array of @p size bytes from frozen_alloc(); NULL is ignored. */
+static void frozen_free(void *p, size_t size) {
+    if (p)
+        munmap(p, frozen_round(size));
+}
+
+/**
+ * @brief Ends a table operation that examined @p probe_len slots: fires the
+ * USDT probe @p name with (probe_len, @p rc) and hands the probe length to
+ * the sampled tracer. Used at every return of the variant probe loops.
+ */
+#define TABLE_PROBE(name, probe_len, rc) do {   \
+        size_t probe_len_ = (probe_len);        \
+        VEGOSH_PROBE2(name, probe_len_, rc);    \
+        trace_probe_len(probe_len_);            \
+    } while (0)
+
+/**
+ * @brief Operations and geometry of one compiled-in table variant.
  *
- * @return 0 on success, -1 if allocation fails.
+ * vegosh_table.h emits one const instance per variant; initializevegosh()
+ * selects which one the public API dispatches to.
  */
-int initializevegosh(void) {
-    /* Verify the slot struct is exactly one cache line at compile time. */
-    static_assert(sizeof(struct Slot) == 64,
-                  "struct Slot must be exactly 64 bytes (one cache line)");
-    static_assert(sizeof(struct Slot) % 64 == 0,
-                  "struct Slot size must be a multiple of 64 bytes");
+struct VegoshTable {
+    size_t key_size;
+    size_t value_size;
+    size_t slot_size;
+    int  (*init)(void);
+    size_t (*region_bytes)(void);
+    int  (*insert)(const uint8_t *key, const uint8_t *value,
+                   const uint16_t *value_len);
+    int  (*restore)(const uint8_t *key, const uint8_t *value,
+                    const uint16_t *value_len, uint32_t version);
+    int  (*cas)(const uint8_t *key, const uint8_t *value,
+                const uint16_t *value_len, uint32_t expected,
+                uint32_t *version);
+    int  (*get_ref)(const uint8_t *key, const uint8_t **out_value,
+                    uint16_t *value_len, uint32_t *version);
+    void (*for_each)(vegosh_visit_fn fn, void *ctx);
+    int  (*scan)(uint32_t cursor, size_t count, vegosh_visit_fn fn,
+                 void *ctx, uint32_t *next);
+    size_t (*footprint)(void);
+    /* Exactly one of these is set: freeze on the live table, thaw on its
+     * frozen index. Each returns the descriptor to switch to, or NULL. */
+    const struct VegoshTable *(*freeze)(void);
+    const struct VegoshTable *(*thaw)(void);
+};
 
-    size_t total_size = sizeof(struct Slot) * TABLE_SIZE;
+/* -------------------------------------------------------------------------
+ * Table variants
+ * ---------------------------------------------------------------------- */
 
-    vegosh = aligned_alloc(64, total_size);
-    if (!vegosh) {
-        perror("aligned_alloc failed");
-        return -1;
-    }
+/* 32-byte slots: two per cache line, for 4-8 byte keys and 8-byte values. */
+#define VT_NAME       vegosh32
+#define VT_KEY_SIZE   8
+#define VT_VALUE_SIZE 8
+#define VT_SLOT_SIZE  32
+#include "vegosh_table.h"
+
+/* 64-byte slots: one per cache line, the original 16/32 layout. */
+#define VT_NAME       vegosh64
+#define VT_KEY_SIZE   16
+#define VT_VALUE_SIZE 32
+#define VT_SLOT_SIZE  64
+#include "vegosh_table.h"
+
+/* 128-byte slots: an adjacent cache-line pair, for 96-byte values. */
+#define VT_NAME       vegosh128
+#define VT_KEY_SIZE   16
+#define VT_VALUE_SIZE 96
+#define VT_SLOT_SIZE  128
+#include "vegosh_table.h"
+
+/** Every compiled-in variant, searched by slot size at startup. */
+static const struct VegoshTable *const variants[] = {
+    &vegosh32_descriptor,
+    &vegosh64_descriptor,
+    &vegosh128_descriptor,
+};
 
-    memset(vegosh, 0, total_size); /* mark every slot EMPTY (status = 0) */
+/* -------------------------------------------------------------------------
+ * Global table state
+ * ---------------------------------------------------------------------- */
 
-    printf("Allocated %zu bytes at %p\n", total_size, (void *)vegosh);
-    return 0;
-}
+/** The variant selected by initializevegosh(); NULL until then. */
+static const struct VegoshTable *active = NULL;
+
+/** Count of successful vegosh_freeze() calls; tags frozen scan cursors. */
+static uint32_t freeze_gen = 0;
 
 /* -------------------------------------------------------------------------
- * Internal helpers
+ * Initialisation
  * ---------------------------------------------------------------------- */
 
 /**
- *  Returns the probe distance of slot @p index from its home bucket.
+ * Brief: Selects the variant with the requested slot size, maps the region
+ * sized for it, and carves out its table and the out-of-line value arena.
  *
- * Because the table wraps, subtraction is done modulo TABLE_SIZE using the
- * pre-computed MASK.
+ * If a region was already attached from a previous process (hot restart),
+ * it is reused as is and its contents adopted, provided the VegoshLayout at
+ * its start matches this build's. Nothing is written to it before that
+ * check, so a refused region is left exactly as it was.
  *
- * @param index  Current slot index.
- * @param home Home slot index (hash & MASK) for the entry at @p index.
- * @return Number of steps the entry has been displaced from home.
+ * @param slot_size   Slot size in bytes of the variant to use.
+ * @param hot_restart Non-zero to back the region with a memfd.
+ * @return 0 on success, -1 on an unknown variant, if allocation fails or
+ *         on a layout mismatch.
  */
-static inline size_t probe_distance(size_t index, size_t home) {
-    return (index + TABLE_SIZE - home) & MASK;
+int initializevegosh(size_t slot_size, int hot_restart) {
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+        if (variants[i]->slot_size != slot_size)
+            continue;
+        size_t bytes = 64 + sizeof(struct VegoshLayout) +
+                       variants[i]->region_bytes() + arena_region_bytes();
+        if (region_attached() ? region_size() < sizeof(struct VegoshLayout)
+                              : region_init(bytes, hot_restart) == -1) {
+            fprintf(stderr, "Region setup failed\n");
+            return -1;
+        }
+
+        struct VegoshLayout  expected;
+        struct VegoshLayout *layout = region_alloc(sizeof(*layout), 64);
+        vegosh_layout(slot_size, &expected);
+        if (!region_attached()) {
+            *layout = expected;
+        } else if (memcmp(layout, &expected, sizeof(expected)) != 0 ||
+                   region_size() < bytes) {
+            fprintf(stderr, "Region layout differs from this build's "
+                            "(magic 0x%08x, version %u, %u-byte slots)\n",
+                    layout->magic, layout->version, layout->slot_size);
+            return -1;
+        }
+
+        if (variants[i]->init() == -1 || arena_init() == -1)
+            return -1;
+        active = variants[i];
+        printf("Table variant: %zu-byte keys, %zu-byte values\n",
+               active->key_size, active->value_size);
+        return 0;
+    }
+    fprintf(stderr, "No table variant with %zu-byte slots\n", slot_size);
+    return -1;
 }
 
+static_assert(ARENA_CLASSES <= VEGOSH_LAYOUT_MAX_CLASSES,
+              "arena classes must fit the region layout header");
+
 /**
- * @brief Atomically swaps the contents of slot @p index with @p temp.
- *
- * After the swap, @p temp holds the old slot contents and vegosh[index]
- * holds what @p temp previously held. The status byte of the newly written
- * slot is explicitly set to OCCUPIED so callers need not worry about it.
- *
- * @param index  Index of the slot to swap with.
- * @param temp Temporary slot buffer used as the exchange partner.
+ * Brief: Describes the region layout of this build for @p slot_size. The
+ * struct is zeroed first so that padding and unused classes compare equal.
  */
-static inline void swap_entry_with_temp(size_t index, struct Slot *temp) {
-    struct Slot old;
-    memcpy(&old,          &vegosh[index], sizeof(struct Slot));
-    memcpy(&vegosh[index],  temp,         sizeof(struct Slot));
-    vegosh[index].status = OCCUPIED; /* guarantee the written slot is marked */
-    memcpy(temp, &old,               sizeof(struct Slot));
+void vegosh_layout(size_t slot_size, struct VegoshLayout *out) {
+    memset(out, 0, sizeof(*out));
+    out->magic         = VEGOSH_LAYOUT_MAGIC;
+    out->version       = VEGOSH_LAYOUT_VERSION;
+    out->slot_size     = (uint32_t)slot_size;
+    out->table_size    = TABLE_SIZE;
+    out->max_keys      = MAX_KEYS;
+    out->max_value_len = VEGOSH_MAX_VALUE_LEN;
+    out->arena_classes = ARENA_CLASSES;
+    for (uint32_t c = 0; c < ARENA_CLASSES; c++)
+        out->arena_blocks[c] = arena_class_blocks(c);
+}
+
+size_t vegosh_key_size(void) {
+    return active->key_size;
+}
+
+size_t vegosh_value_size(void) {
+    return active->value_size;
+}
+
+size_t vegosh_slot_size(void) {
+    return active->slot_size;
 }
 
 /* -------------------------------------------------------------------------
@@ -113,81 +275,28 @@ static inline void swap_entry_with_temp(size_t index, struct Slot *temp) {
  *  5. On finding an incumbent whose displacement is less than ours, evict it
  *     (Robin Hood swap) and continue inserting the displaced entry.
  *
- * @param key   Pointer to exactly 16 bytes of key data.
- * @param value Pointer to exactly 32 bytes of value data.
- * @return 0 on success, -2 if the table or key cap is exhausted, 1 if the key already exists and is updated.
- */
- int insert(const uint8_t *key, const uint8_t *value, const uint8_t *value_len) {
-     /* Cache the lower 32 bits of the 64-bit hash alongside each entry so we
-      * can quickly skip non-matching slots and compute probe distances without
-      * re-hashing. */
-     uint32_t hash = (uint32_t)(XXH3_64bits(key, 16) & 0xFFFFFFFF);
-     size_t   home = hash & MASK;
-     size_t   index  = home;
-     size_t   dist = 0; /* displacement of the entry we are trying to place */
-
-     /* Build the entry to insert in a local buffer. */
-     struct Slot temp = {0};
-     memcpy(temp.key,   key,   16);
-     memcpy(temp.value, value, 32);
-     temp.value_len = *value_len;
-     temp.crc32 = crc32(0L, (const Bytef *)temp.key, 16);
-     temp.crc32 = crc32(temp.crc32, (const Bytef *)temp.value, 32);
-     temp.crc32 = crc32(temp.crc32, (const Bytef *)&temp.value_len, 1);
-     temp.hash   = hash;
-     temp.crc32 = crc32(temp.crc32, (const Bytef *)&temp.hash, 4);
-     temp.status = OCCUPIED;
-     temp.crc32 = crc32(temp.crc32, (const Bytef *)&temp.status, 1);
-
-     while (1) {
-         struct Slot *slot = &vegosh[index];
-
-         /* Case 1: empty slot – write the entry here. */
-         if (slot->status == EMPTY) {
-             if (vegosh_count >= MAX_KEYS) {
-                 return -2; /* hard key cap reached */
-             }
-             memcpy(slot, &temp, sizeof(struct Slot));
-             slot->status = OCCUPIED;
-             vegosh_count++;
-             return 0;
-         }
-
-         /* Case 2: same key – update value without consuming a new slot. */
-         if (slot->hash == temp.hash &&
-             memcmp(slot->key, temp.key, 16) == 0) {
-             slot->value_len = temp.value_len;
-             memcpy(slot->value, temp.value, temp.value_len);
-             slot->crc32 = temp.crc32;
-
-
-             return 1;
-         }
-
-
-
-         /* Case 3: Robin Hood eviction.
-          * If the incumbent is closer to its home than we are to ours,
-          * steal its slot and continue placing the displaced entry. */
-         size_t occ_home = slot->hash & MASK;
-         size_t occ_dist = probe_distance(index, occ_home);
-
-         if (occ_dist < dist) {
-             /* Swap our entry into this slot; continue with the evicted one. */
-             swap_entry_with_temp(index, &temp);
-             dist = occ_dist; /* reset dist to the evicted entry's displacement */
-         }
-
-         /* Advance to the next slot (linear probing). */
-         index = (index + 1) & MASK;
-         dist++;
-
-         /* Safety guard: wrapped all the way around – table is completely full. */
-         if (dist >= TABLE_SIZE) {
-             return -2;
-         }
-     }
- }
+ * The loop itself lives in vegosh_table.h, specialised per variant.
+ *
+ * Values longer than the variant's inline width are copied into the arena
+ * first and the slot stores the handle; overwriting such a key returns the
+ * old block to the arena.
+ *
+ * @param key   Pointer to exactly vegosh_key_size() bytes of key data.
+ * @param value Pointer to max(*value_len, vegosh_value_size()) bytes.
+ * @return 0 on success, -2 if the table or key cap is exhausted, 1 if the key already exists and is updated, -3 if the table is frozen, -5 if the arena class is exhausted.
+ */
+int insert(const uint8_t *key, const uint8_t *value, const uint16_t *value_len) {
+    return active->insert(key, value, value_len);
+}
+
+/**
+ * @brief Inserts a key with a given version; the same probe as insert(),
+ * with the version set on the built entry instead of 1.
+ */
+int restore(const uint8_t *key, const uint8_t *value, const uint16_t *value_len,
+            uint32_t version) {
+    return active->restore(key, value, value_len, version);
+}
 
 /**
  * @brief Looks up a key and copies its associated value into @p out_value.
@@ -197,47 +306,129 @@ static inline void swap_entry_with_temp(size_t index, struct Slot *temp) {
  * we have, our key cannot appear later in the probe chain (it would have
  * evicted this entry during insertion).
  *
- * @param key       Pointer to exactly 16 bytes of key data.
- * @param out_value Destination buffer of at least 32 bytes; written on hit.
+ * @param key       Pointer to exactly vegosh_key_size() bytes of key data.
+ * @param out_value Destination buffer of at least VEGOSH_MAX_VALUE_LEN bytes.
  * @return 0 if found (value written), -1 if the key is not present.
  */
-int get(const uint8_t *key, uint8_t *out_value, uint8_t *value_len) {
-    uint32_t hash = (uint32_t)(XXH3_64bits(key, 16) & 0xFFFFFFFF);
-    size_t   home = hash & MASK;
-    size_t   index  = home;
-    size_t   dist = 0;
+int get(const uint8_t *key, uint8_t *out_value, uint16_t *value_len) {
+    const uint8_t *ref;
+    if (active->get_ref(key, &ref, value_len, NULL) == -1)
+        return -1;
+    memcpy(out_value, ref, *value_len);
+    return 0;
+}
 
-    while (1) {
-        struct Slot *slot = &vegosh[index];
+/**
+ * @brief Zero-copy variant of get(): points @p out_value at the slot or
+ * arena bytes so the caller can hand them straight to writev(), and
+ * reports the entry's version if @p version is not NULL.
+ *
+ * @return 0 if found, -1 if the key is not present.
+ */
+int get_ref(const uint8_t *key, const uint8_t **out_value, uint16_t *value_len,
+            uint32_t *version) {
+    return active->get_ref(key, out_value, value_len, version);
+}
 
-        /* An empty slot means the key was never inserted. */
-        if (slot->status == EMPTY) {
-            return -1;
-        }
+/**
+ * @brief Writes @p key only if its version is still @p expected, in one
+ * probe: the variant's lookup stops where its insert would begin writing
+ * and the insert carries on from there.
+ *
+ * @return 0 if created, 1 if updated (*version = new version), -2 if the
+ *         table is full, -3 if frozen, -4 on a version mismatch
+ *         (*version = current version, 0 if absent), -5 if the arena class
+ *         is exhausted.
+ */
+int cas(const uint8_t *key, const uint8_t *value, const uint16_t *value_len,
+        uint32_t expected, uint32_t *version) {
+    return active->cas(key, value, value_len, expected, version);
+}
 
-        /* Hash comparison is a cheap pre-filter before the full memcmp. */
-        if (slot->hash == hash &&
-            memcmp(slot->key, key, 16) == 0) {
-            memcpy(out_value, slot->value, 32);
-            *value_len = slot->value_len;
-            return 0;
-        }
+/**
+ * @brief Compacts the live table into a read-only frozen index.
+ *
+ * Switching descriptors means frozen lookups pay no extra branch; insert()
+ * on the frozen descriptor simply returns -3.
+ *
+ * @return 0 on success, 1 if already frozen, -1 if the build failed (the
+ *         live table stays in service).
+ */
+int vegosh_freeze(void) {
+    if (!active->freeze)
+        return 1;
+    const struct VegoshTable *frozen = active->freeze();
+    if (!frozen)
+        return -1;
+    active = frozen;
+    freeze_gen++;
+    return 0;
+}
 
-        /* Robin Hood early-exit: if this incumbent is closer to its home
-         * than we are to ours, our key cannot be here or beyond. */
-        size_t occ_home = slot->hash & MASK;
-        size_t occ_dist = probe_distance(index, occ_home);
+/**
+ * @brief Rebuilds the live table from the frozen index.
+ * @return 0 on success, 1 if not frozen, -1 if allocation failed.
+ */
+int vegosh_thaw(void) {
+    if (!active->thaw)
+        return 1;
+    const struct VegoshTable *live = active->thaw();
+    if (!live)
+        return -1;
+    active = live;
+    return 0;
+}
 
-        if (occ_dist < dist) {
-            return -1;
-        }
+/**
+ * @brief Non-zero while the frozen index is active.
+ */
+int vegosh_frozen(void) {
+    return active->thaw != NULL;
+}
 
-        index = (index + 1) & MASK;
-        dist++;
+/**
+ * @brief Bytes held by the active table (live slots or frozen index),
+ * excluding the value arena.
+ */
+size_t vegosh_footprint(void) {
+    return active->footprint();
+}
 
-        /* Safety guard against a completely full table with no match. */
-        if (dist >= TABLE_SIZE) {
+/**
+ * @brief Calls @p fn for every stored entry, in slot order.
+ */
+void vegosh_for_each(vegosh_visit_fn fn, void *ctx) {
+    active->for_each(fn, ctx);
+}
+
+static_assert(TABLE_SIZE <= 1u << VEGOSH_SCAN_BUCKET_BITS,
+              "live buckets must fit the scan cursor");
+static_assert((uint64_t)MAX_KEYS * 100 / FROZEN_MIN_LOAD + 1
+                  < 1u << VEGOSH_SCAN_BUCKET_BITS,
+              "frozen buckets must fit the scan cursor");
+
+/**
+ * @brief Continues a scan at @p cursor. The variant works in its own home
+ * bucket numbering; this layer tags frozen cursors with VEGOSH_SCAN_FROZEN
+ * and the current freeze generation, so one issued against another index
+ * is rejected instead of misread. Live cursors carry no tag, and any bits
+ * above the bucket put them out of range of the live scan.
+ */
+int vegosh_scan(uint32_t cursor, size_t count, vegosh_visit_fn fn, void *ctx,
+                uint32_t *next) {
+    uint32_t bucket = cursor & ((1u << VEGOSH_SCAN_BUCKET_BITS) - 1);
+    uint32_t tag    = 0;
+
+    if (vegosh_frozen()) {
+        tag = VEGOSH_SCAN_FROZEN |
+              (freeze_gen & VEGOSH_SCAN_GEN_MASK) << VEGOSH_SCAN_BUCKET_BITS;
+        if (cursor != 0 && cursor - bucket != tag)
             return -1;
-        }
+        cursor = bucket;
     }
+    if (active->scan(cursor, count, fn, ctx, next) == -1)
+        return -1;
+    if (*next != 0)
+        *next |= tag;
+    return 0;
 }
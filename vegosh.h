@@ -1,10 +1,11 @@
 /**
  * @file vegosh.h
- * @brief Fixed-size Robin Hood open-addressing hash map with 16-byte keys
- *        and 32-byte values. All slots are cache-line aligned (64 bytes).
+ * @brief Fixed-size Robin Hood open-addressing hash map. Key width, value
+ *        width and slot size are compile-time parameters; the server picks
+ *        one of the compiled-in variants at startup.
  *
  * Usage:
- *   initializevegosh() → insert() / get()
+ *   initializevegosh(slot_size, hot_restart) → insert() / get()
  */
 
 #ifndef VEGOSH_H
@@ -27,45 +28,133 @@
 /** Hard cap on the number of distinct keys that may be stored. */
 #define MAX_KEYS 1000000
 
+/** Target load factor of a frozen index, in percent. */
+#define FROZEN_LOAD_PERCENT 80
+
+/** Longest displacement a frozen index may have; see vegosh_freeze(). */
+#define FROZEN_MAX_PROBE 31
+
+/** Load reduction, in percent, per rebuild of an index over the bound. */
+#define FROZEN_LOAD_STEP 5
+
+/** Lowest load a frozen index is rebuilt at before FREEZE gives up. */
+#define FROZEN_MIN_LOAD 50
+
+/** Spare buckets past the end of a frozen index, which never wraps. */
+#define FROZEN_TAIL 64
+
 /** Slot status: no entry present. */
 #define EMPTY  0x00
 
 /** Slot status: entry is present. */
 #define OCCUPIED 0x01
 
+/** Largest key width of any compiled-in table variant. */
+#define VEGOSH_MAX_KEY_SIZE   16
+
+/** Largest inline value width of any compiled-in table variant. */
+#define VEGOSH_MAX_VALUE_SIZE 96
+
+/**
+ * Longest value accepted over the wire. Values wider than the active
+ * variant's inline field are stored out of line in the slab arena (arena.h).
+ */
+#ifndef VEGOSH_MAX_VALUE_LEN
+#define VEGOSH_MAX_VALUE_LEN 1024
+#endif
+
 /**
- * @struct Slot
- * @brief One entry in the hash table.
+ * Work one vegosh_scan() call may do before returning: each slot walked
+ * costs 1 and each entry visited VEGOSH_SCAN_ENTRY_COST more. Sized so a
+ * batch stays within a few microseconds on a warm table; see README.md
+ * (Scanning) for measured costs.
+ */
+#define VEGOSH_SCAN_BUDGET 1024
+
+/** Extra scan work charged per visited entry; see VEGOSH_SCAN_BUDGET. */
+#define VEGOSH_SCAN_ENTRY_COST 2
+
+/**
+ * Low cursor bits holding the home bucket. Above them a frozen cursor
+ * carries VEGOSH_SCAN_FROZEN and the freeze generation it was issued in.
+ */
+#define VEGOSH_SCAN_BUCKET_BITS 21
+
+/** Cursor bit marking a scan position in the frozen index. */
+#define VEGOSH_SCAN_FROZEN 0x80000000u
+
+/** Mask of the freeze generation field, above the bucket bits. */
+#define VEGOSH_SCAN_GEN_MASK 0x3ffu
+
+/** First word of every region laid out by initializevegosh(): "VGSH". */
+#define VEGOSH_LAYOUT_MAGIC 0x48534756u
+
+/** Bumped whenever the order or shape of the region's allocations changes. */
+#define VEGOSH_LAYOUT_VERSION 1
+
+/** Arena classes a VegoshLayout has room for. */
+#define VEGOSH_LAYOUT_MAX_CLASSES 16
+
+/**
+ * @struct VegoshLayout
+ * @brief Every build and startup parameter the region layout depends on.
  *
- * The struct is padded to exactly 64 bytes so that each slot maps to a
- * single cache line, eliminating false sharing and improving prefetch
- * efficiency on sequential probes.
+ * initializevegosh() stores one at the start of the region and compares it
+ * on attach, so a binary built with other limits refuses an inherited
+ * region instead of reading its table and arena at the wrong offsets.
+ */
+struct VegoshLayout {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t table_size;
+    uint32_t max_keys;
+    uint32_t max_value_len;
+    uint32_t arena_classes;
+    uint32_t arena_blocks[VEGOSH_LAYOUT_MAX_CLASSES]; /* unused ones are 0 */
+};
+
+/**
+ * @brief Fills @p out with the layout this build gives a region for the
+ *        variant with @p slot_size-byte slots.
+ */
+void vegosh_layout(size_t slot_size, struct VegoshLayout *out);
+
+/** Slot size used when the server is started without an explicit variant. */
+#define VEGOSH_DEFAULT_SLOT_SIZE 64
+
+/**
+ * Compiled-in table variants, selected by slot size at startup. Each one is
+ * generated from vegosh_table.h with its own static layout assertions.
  *
- * Layout:
- *   key      [0..15]   – raw 16-byte key
- *   value    [16..47]  – raw 32-byte value
- *   hash     [48..51]  – cached lower 32 bits of the XXH3 hash
- *   value_len[52]      – length of the value in bytes
- *   status   [53]      – EMPTY or OCCUPIED
- *   CRC32    [54..57]  – CRC32 checksum of the value
- *   reserved [58..63]  – padding to reach 64 bytes
+ *   slot  key  value  use case
+ *    32     8      8  IPv4 / integer keys, counters (rate limiting)
+ *    64    16     32  UUID / IPv6 keys, small records (the default)
+ *   128    16     96  UUID keys with larger session payloads
  *
- *  */
- struct Slot {
-     uint8_t  key[16];
-     uint8_t  value[32];
-     uint32_t hash;
-     uint32_t crc32;
-     uint8_t  status;
-     uint8_t  value_len;
-     uint8_t  reserved[6];
- };
+ * All variants share the slot metadata layout: after key and value come
+ * hash (4), CRC32 (4), value_len (2), status (1), version (4), then
+ * reserved padding.
+ * A value_len larger than the inline width means the value field holds a
+ * 4-byte arena handle instead of the bytes themselves.
+ */
 
 /**
- * @brief Allocates and zero-initialises the global hash table.
- * @return 0 on success, -1 if allocation fails.
+ * @brief Selects a table variant and maps its zero-initialised slots along
+ *        with the value arena, or adopts an attached region (region.h).
+ * @param slot_size   Slot size of the variant to use (32, 64 or 128).
+ * @param hot_restart Non-zero to keep the table in a memfd that can be
+ *                    handed to a new process.
+ * @return 0 on success, -1 on an unknown variant, if allocation fails or
+ *         if an attached region has a different VegoshLayout.
  */
-int initializevegosh(void);
+int initializevegosh(size_t slot_size, int hot_restart);
+
+/** @brief Key width in bytes of the active variant. */
+size_t vegosh_key_size(void);
+
+/** @brief Inline value width in bytes of the active variant. */
+size_t vegosh_value_size(void);
 
 /**
  * @brief Inserts or updates a key-value pair.
@@ -73,19 +162,142 @@ int initializevegosh(void);
  * If the key already exists its value is overwritten without consuming an
  * additional slot. New insertions are rejected once MAX_KEYS is reached.
  *
- * @param key   Pointer to exactly 16 bytes of key data.
- * @param value Pointer to exactly 32 bytes of value data.
- * @return 0 on success, -1 if the table is full or the key cap is reached.
+ * @param key   Pointer to exactly vegosh_key_size() bytes of key data.
+ * @param value Pointer to max(*value_len, vegosh_value_size()) bytes of
+ *              value data, zero padded.
+ * @return 0 on success, 1 if an existing key was updated, -2 if the table
+ *         or the key cap is exhausted, -3 if the table is frozen, -5 if the
+ *         value's arena size class is exhausted.
+ */
+int insert(const uint8_t *key, const uint8_t *value, const uint16_t *value_len);
+
+/**
+ * @brief insert() for a key that is not in the table yet, storing
+ *        @p version instead of starting it at 1.
+ *
+ * Used by snapshot_load() so that versions a client may already hold stay
+ * valid across a restore.
+ *
+ * @return As for insert().
  */
-int insert(const uint8_t *key, const uint8_t *value,const uint8_t *value_len);
+int restore(const uint8_t *key, const uint8_t *value, const uint16_t *value_len,
+            uint32_t version);
 
 /**
  * @brief Looks up a key and copies its value into @p out_value.
  *
- * @param key       Pointer to exactly 16 bytes of key data.
- * @param out_value Destination buffer of at least 32 bytes.
+ * @param key       Pointer to exactly vegosh_key_size() bytes of key data.
+ * @param out_value Destination buffer of at least *value_len bytes; a buffer
+ *                  of VEGOSH_MAX_VALUE_LEN bytes always suffices.
  * @return 0 if found (value written to @p out_value), -1 if not found.
  */
-int get(const uint8_t *key, uint8_t *out_value, uint8_t *value_len);
+int get(const uint8_t *key, uint8_t *out_value, uint16_t *value_len);
+
+/**
+ * @brief Looks up a key and points @p out_value at its stored bytes.
+ *
+ * No copy is made: the pointer refers to the slot for inline values and to
+ * the arena for external ones, and stays valid until the next insert().
+ *
+ * @param key       Pointer to exactly vegosh_key_size() bytes of key data.
+ * @param out_value Set to the value bytes on hit.
+ * @param version   If not NULL, set to the entry's version on hit.
+ * @return 0 if found, -1 if not found.
+ */
+int get_ref(const uint8_t *key, const uint8_t **out_value, uint16_t *value_len,
+            uint32_t *version);
+
+/**
+ * @brief Inserts or updates a key only if its version equals @p expected.
+ *
+ * Every entry carries a version: 1 when created, incremented (skipping 0)
+ * on every update by insert() or cas(). An @p expected of 0 means "only if
+ * absent". The check and the write share a single probe.
+ *
+ * Versions live in the slot and in snapshot records, so they survive
+ * FREEZE/THAW, a hot restart and a snapshot restore. A restore does roll
+ * back whatever was written after the dump, versions included.
+ *
+ * @param key     Pointer to exactly vegosh_key_size() bytes of key data.
+ * @param value   As for insert().
+ * @param version On success set to the new version; on a mismatch set to
+ *                the current one (0 if the key is absent).
+ * @return 0 if the key was created, 1 if it was updated, -2 if the table
+ *         or the key cap is exhausted, -3 if the table is frozen, -4 on a
+ *         version mismatch, -5 if the value's arena size class is exhausted.
+ */
+int cas(const uint8_t *key, const uint8_t *value, const uint16_t *value_len,
+        uint32_t expected, uint32_t *version);
+
+/**
+ * @brief Compacts the live table into an immutable, read-optimised index.
+ *
+ * The frozen index runs at FROZEN_LOAD_PERCENT load with fingerprints kept
+ * apart from the slots, so it is smaller than the live table. If its
+ * longest displacement exceeds FROZEN_MAX_PROBE it is rebuilt at a lower
+ * load, so a lookup scans at most two fingerprint cache lines, then reads
+ * one slot per fingerprint match. insert() returns -3 until vegosh_thaw().
+ *
+ * @return 0 on success, 1 if already frozen, -1 on failure.
+ */
+int vegosh_freeze(void);
+
+/**
+ * @brief Rebuilds the writable table from the frozen index.
+ * @return 0 on success, 1 if not frozen, -1 on failure.
+ */
+int vegosh_thaw(void);
+
+/** @brief Non-zero while the frozen index is active. */
+int vegosh_frozen(void);
+
+/** @brief Bytes held by the active table, excluding the value arena. */
+size_t vegosh_footprint(void);
+
+/**
+ * @brief Callback invoked by vegosh_for_each() for every stored entry.
+ *
+ * @p key is vegosh_key_size() bytes; @p value points at the inline or arena
+ * bytes and is only valid for the duration of the call. @p version is the
+ * entry's version (see cas()).
+ */
+typedef void (*vegosh_visit_fn)(const uint8_t *key, const uint8_t *value,
+                                uint16_t value_len, uint32_t version,
+                                void *ctx);
+
+/**
+ * @brief Visits every OCCUPIED slot in table order.
+ *
+ * Used by the snapshot writer, which runs it in a forked child against a
+ * copy-on-write view of the table.
+ */
+void vegosh_for_each(vegosh_visit_fn fn, void *ctx);
+
+/**
+ * @brief Visits a bounded batch of entries and returns where to resume.
+ *
+ * Entries are visited in home bucket order. Start with @p cursor 0 and pass
+ * each *next back in until it is 0. A batch holds whole home buckets: it
+ * ends at the first bucket boundary after @p count entries, or once
+ * VEGOSH_SCAN_BUDGET is spent, so it may be empty or slightly exceed
+ * @p count. Every key present for the whole scan is visited at least once
+ * however inserts displace entries between calls.
+ *
+ * Live cursors number the live table's home buckets, which a FREEZE/THAW
+ * round trip leaves unchanged, so they stay valid across one. Frozen
+ * cursors are tagged with the freeze they came from, as each freeze sizes
+ * its index afresh; the generation is 10 bits wide, so only a cursor 1024
+ * freezes old can be mistaken for a current one.
+ *
+ * @param next Set to the cursor for the next call, or 0 when complete.
+ * @return 0 on success, -1 if @p cursor is out of range, is a live cursor
+ *         while frozen (or vice versa), or comes from an earlier freeze
+ *         (start again from 0).
+ */
+int vegosh_scan(uint32_t cursor, size_t count, vegosh_visit_fn fn, void *ctx,
+                uint32_t *next);
+
+/** @brief Slot size in bytes of the active variant. */
+size_t vegosh_slot_size(void);
 
 #endif /* VEGOSH_H */
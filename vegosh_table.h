@@ -0,0 +1,824 @@
+/**
+ * @file vegosh_table.h
+ * @brief Template for one compile-time specialised Robin Hood table.
+ *
+ * This is not an ordinary header: it has no include guard and is included
+ * by vegosh.c once per table variant. Before each inclusion define:
+ *
+ *   VT_NAME        – prefix for every generated symbol (e.g. vegosh64)
+ *   VT_KEY_SIZE    – key width in bytes
+ *   VT_VALUE_SIZE  – inline value width in bytes; longer values go to the
+ *                    arena and the field holds their 4-byte handle
+ *   VT_SLOT_SIZE   – slot size in bytes (32, 64 or 128)
+ *
+ * Every generated symbol is static, and all four parameters are #undef'd
+ * again at the bottom so the next variant starts clean. Because the widths
+ * are constants, the compiler folds every memcpy/memcmp/hash length and
+ * emits a dedicated insert()/get() for each layout.
+ */
+
+#define VT_CAT_(a, b) a##_##b
+#define VT_CAT(a, b)  VT_CAT_(a, b)
+#define VT_(sym)      VT_CAT(VT_NAME, sym)
+
+/** Bytes left over after key, value and the 11 bytes of metadata. */
+#define VT_RESERVED (VT_SLOT_SIZE - VT_KEY_SIZE - VT_VALUE_SIZE - 11)
+
+/** Scan work of reading one slot: the cache lines it spans, at least 1. */
+#define VT_SCAN_SLOT_COST (VT_SLOT_SIZE > 64 ? VT_SLOT_SIZE / 64 : 1)
+
+/**
+ * One entry in this variant's table.
+ *
+ * Layout (offsets relative to the slot):
+ *   key      [0 .. K-1]         – raw key, zero padded
+ *   value    [K .. K+V-1]       – raw value, or arena handle if value_len > V
+ *   hash     [K+V .. K+V+3]     – cached lower 32 bits of the XXH3 hash
+ *   CRC32    [K+V+4 .. K+V+7]   – CRC32 checksum of the entry
+ *   value_len[K+V+8 .. K+V+9]   – length of the value in bytes
+ *   status   [K+V+10]           – EMPTY or OCCUPIED
+ *   version  [K+V+11 .. K+V+14] – bumped on every update, see VT_(version)
+ *   reserved [K+V+15 .. S-1]    – padding up to VT_SLOT_SIZE
+ */
+struct VT_(slot) {
+    uint8_t  key[VT_KEY_SIZE];
+    uint8_t  value[VT_VALUE_SIZE];
+    uint32_t hash;
+    uint32_t crc32;
+    uint16_t value_len;
+    uint8_t  status;
+    uint8_t  version[4];
+    uint8_t  reserved[VT_RESERVED - 4];
+};
+
+static_assert((VT_KEY_SIZE + VT_VALUE_SIZE) % 4 == 0,
+              "key + value width must keep hash/crc32 4-byte aligned");
+static_assert(VT_RESERVED > 4,
+              "key + value + metadata + version must fit inside the slot");
+static_assert(sizeof(struct VT_(slot)) == VT_SLOT_SIZE,
+              "slot struct must be exactly VT_SLOT_SIZE bytes");
+static_assert(64 % VT_SLOT_SIZE == 0 || VT_SLOT_SIZE % 64 == 0,
+              "slots must never straddle a cache line boundary");
+static_assert(VT_VALUE_SIZE >= sizeof(uint32_t),
+              "value field must be able to hold an arena handle");
+static_assert(VT_VALUE_SIZE <= VEGOSH_MAX_VALUE_SIZE &&
+              VT_KEY_SIZE <= VEGOSH_MAX_KEY_SIZE,
+              "variant exceeds the protocol-wide size limits");
+
+/** Pointer to this variant's slot array; NULL until VT_(init) runs. */
+static struct VT_(slot) *VT_(table) = NULL;
+
+/**
+ * Number of unique keys currently stored in this variant's table. Lives in
+ * the region next to the slots so it survives a hot restart with them.
+ */
+static uint64_t *VT_(count) = NULL;
+
+/** Region bytes VT_(init) needs, including alignment slack. */
+static size_t VT_(region_bytes)(void) {
+    return 64 + sizeof(struct VT_(slot)) * TABLE_SIZE + VT_SLOT_SIZE + 64;
+}
+
+/**
+ * Carves the key count and the slot array out of the region, aligned so
+ * that no slot ever straddles two cache lines. A fresh region is already
+ * zero, i.e. every slot EMPTY; an inherited one keeps its entries.
+ */
+static int VT_(init)(void) {
+    size_t total_size = sizeof(struct VT_(slot)) * TABLE_SIZE;
+    size_t align      = VT_SLOT_SIZE < 64 ? 64 : VT_SLOT_SIZE;
+
+    VT_(count) = region_alloc(sizeof(*VT_(count)), 64);
+    VT_(table) = region_alloc(total_size, align);
+    if (!VT_(count) || !VT_(table)) {
+        fprintf(stderr, "table: region exhausted\n");
+        return -1;
+    }
+
+    printf("Mapped %zu bytes at %p (%d-byte slots, %llu keys)\n",
+           total_size, (void *)VT_(table), VT_SLOT_SIZE,
+           (unsigned long long)*VT_(count));
+    return 0;
+}
+
+/**
+ * Swaps the contents of slot @p index with @p temp and marks the written
+ * slot OCCUPIED. See insert() in vegosh.c for how this drives Robin Hood
+ * displacement.
+ */
+static inline void VT_(swap_entry_with_temp)(size_t index,
+                                             struct VT_(slot) *temp) {
+    struct VT_(slot) old;
+    memcpy(&old,              &VT_(table)[index], sizeof(old));
+    memcpy(&VT_(table)[index], temp,              sizeof(old));
+    VT_(table)[index].status = OCCUPIED;
+    memcpy(temp, &old,                            sizeof(old));
+}
+
+/** True if @p slot keeps its value in the arena rather than inline. */
+static inline int VT_(is_external)(const struct VT_(slot) *slot) {
+    return slot->value_len > VT_VALUE_SIZE;
+}
+
+/** Arena handle stored in the value field of an external @p slot. */
+static inline uint32_t VT_(handle)(const struct VT_(slot) *slot) {
+    uint32_t handle;
+    memcpy(&handle, slot->value, sizeof(handle));
+    return handle;
+}
+
+/**
+ * Version of @p slot. The field sits in what used to be reserved padding,
+ * so it is unaligned. Entries written before it existed hold 0 there; they
+ * read as 1, since 0 means "absent" to cas() and its clients.
+ */
+static inline uint32_t VT_(version)(const struct VT_(slot) *slot) {
+    uint32_t version;
+    memcpy(&version, slot->version, sizeof(version));
+    return version ? version : 1;
+}
+
+static inline void VT_(set_version)(struct VT_(slot) *slot, uint32_t version) {
+    memcpy(slot->version, &version, sizeof(version));
+}
+
+/**
+ * Places a fully built @p entry with Robin Hood displacement, starting at
+ * slot @p index, @p dist buckets from its home: the probe loop behind
+ * insert() (which starts at home) and cas() (which resumes where its
+ * lookup stopped), also used to rebuild the live table on thaw. An update
+ * bumps the stored version; a new entry keeps the one it carries. Same
+ * return codes as insert().
+ */
+static int VT_(place)(const struct VT_(slot) *entry, size_t index, size_t dist) {
+    struct VT_(slot) temp = *entry; /* swap buffer for displaced entries */
+    size_t   home  = temp.hash & MASK;
+
+    while (1) {
+        struct VT_(slot) *slot = &VT_(table)[index];
+
+        /* Case 1: empty slot – write the entry here. */
+        if (slot->status == EMPTY) {
+            if (*VT_(count) >= MAX_KEYS) {
+                if (VT_(is_external)(&temp))
+                    arena_free(VT_(handle)(&temp));
+                TABLE_PROBE(insert, probe_distance(index, home) + 1, -2);
+                return -2; /* hard key cap reached */
+            }
+            memcpy(slot, &temp, sizeof(temp));
+            slot->status = OCCUPIED;
+            (*VT_(count))++;
+            TABLE_PROBE(insert, probe_distance(index, home) + 1, 0);
+            return 0;
+        }
+
+        /* Case 2: same key – update value without consuming a new slot. */
+        if (slot->hash == temp.hash &&
+            memcmp(slot->key, temp.key, VT_KEY_SIZE) == 0) {
+            if (VT_(is_external)(slot))
+                arena_free(VT_(handle)(slot));
+            slot->value_len = temp.value_len;
+            memcpy(slot->value, temp.value, VT_VALUE_SIZE);
+            slot->crc32 = temp.crc32;
+            VT_(set_version)(slot, next_version(VT_(version)(slot)));
+            TABLE_PROBE(insert, probe_distance(index, home) + 1, 1);
+            return 1;
+        }
+
+        /* Case 3: Robin Hood eviction. */
+        size_t occ_home = slot->hash & MASK;
+        size_t occ_dist = probe_distance(index, occ_home);
+
+        if (occ_dist < dist) {
+            VT_(swap_entry_with_temp)(index, &temp);
+            dist = occ_dist;
+        }
+
+        index = (index + 1) & MASK;
+        dist++;
+
+        if (dist >= TABLE_SIZE) {
+            if (VT_(is_external)(&temp))
+                arena_free(VT_(handle)(&temp));
+            TABLE_PROBE(insert, TABLE_SIZE, -2);
+            return -2;
+        }
+    }
+}
+
+/**
+ * Builds the entry for @p key in @p temp, moving a value too large to
+ * inline into the arena. A new entry starts at version 1.
+ *
+ * @return 0, or -5 if the value's arena size class is exhausted.
+ */
+static int VT_(build)(struct VT_(slot) *out, uint32_t hash, const uint8_t *key,
+                      const uint8_t *value, const uint16_t *value_len) {
+    struct VT_(slot) temp = {0};
+    memcpy(temp.key, key, VT_KEY_SIZE);
+    temp.value_len = *value_len;
+    temp.crc32 = crc32(0L, (const Bytef *)temp.key, VT_KEY_SIZE);
+    if (VT_(is_external)(&temp)) {
+        /* Too large to inline: park the bytes in the arena, keep the handle. */
+        uint32_t handle = arena_alloc(value, temp.value_len);
+        if (handle == ARENA_NULL) {
+            return -5; /* size class exhausted */
+        }
+        memcpy(temp.value, &handle, sizeof(handle));
+        temp.crc32 = crc32(temp.crc32, (const Bytef *)value, temp.value_len);
+    } else {
+        memcpy(temp.value, value, VT_VALUE_SIZE);
+        temp.crc32 = crc32(temp.crc32, (const Bytef *)temp.value, VT_VALUE_SIZE);
+    }
+    temp.crc32 = crc32(temp.crc32, (const Bytef *)&temp.value_len, 2);
+    temp.hash   = hash;
+    temp.crc32 = crc32(temp.crc32, (const Bytef *)&temp.hash, 4);
+    temp.status = OCCUPIED;
+    temp.crc32 = crc32(temp.crc32, (const Bytef *)&temp.status, 1);
+    VT_(set_version)(&temp, 1);
+
+    *out = temp;
+    return 0;
+}
+
+/** Robin Hood insert for this variant; see insert() for the contract. */
+static int VT_(insert)(const uint8_t *key, const uint8_t *value,
+                       const uint16_t *value_len) {
+    uint32_t hash = (uint32_t)(XXH3_64bits(key, VT_KEY_SIZE) & 0xFFFFFFFF);
+
+    /* Build the entry to insert in a local buffer. */
+    struct VT_(slot) temp;
+    if (VT_(build)(&temp, hash, key, value, value_len) == -5)
+        return -5;
+
+    return VT_(place)(&temp, hash & MASK, 0);
+}
+
+/** insert() that keeps @p version; see restore(). */
+static int VT_(restore)(const uint8_t *key, const uint8_t *value,
+                        const uint16_t *value_len, uint32_t version) {
+    uint32_t hash = (uint32_t)(XXH3_64bits(key, VT_KEY_SIZE) & 0xFFFFFFFF);
+
+    struct VT_(slot) temp;
+    if (VT_(build)(&temp, hash, key, value, value_len) == -5)
+        return -5;
+    VT_(set_version)(&temp, version);
+
+    return VT_(place)(&temp, hash & MASK, 0);
+}
+
+/**
+ * Compare-and-swap for this variant; see cas() for the contract.
+ *
+ * The lookup stops exactly where place() would first write or displace,
+ * since no swap can happen before that point, so a write resumes the same
+ * probe there instead of starting again from home.
+ */
+static int VT_(cas)(const uint8_t *key, const uint8_t *value,
+                    const uint16_t *value_len, uint32_t expected,
+                    uint32_t *version) {
+    uint32_t hash  = (uint32_t)(XXH3_64bits(key, VT_KEY_SIZE) & 0xFFFFFFFF);
+    size_t   index = hash & MASK;
+    size_t   dist  = 0;
+    int      found   = 0;
+    uint32_t current = 0; /* stays 0 while the key is absent */
+
+    while (1) {
+        struct VT_(slot) *slot = &VT_(table)[index];
+
+        if (slot->status == EMPTY)
+            break;
+
+        if (slot->hash == hash &&
+            memcmp(slot->key, key, VT_KEY_SIZE) == 0) {
+            found   = 1;
+            current = VT_(version)(slot);
+            break;
+        }
+
+        if (probe_distance(index, slot->hash & MASK) < dist)
+            break;
+
+        index = (index + 1) & MASK;
+        dist++;
+
+        if (dist >= TABLE_SIZE)
+            return -2;
+    }
+
+    if (found ? expected == 0 || current != expected : expected != 0) {
+        TABLE_PROBE(cas, dist + 1, -4);
+        *version = current;
+        return -4;
+    }
+
+    struct VT_(slot) temp;
+    if (VT_(build)(&temp, hash, key, value, value_len) == -5)
+        return -5;
+
+    int result = VT_(place)(&temp, index, dist);
+    if (result >= 0)
+        *version = found ? next_version(current) : 1;
+    return result;
+}
+
+/**
+ * Robin Hood lookup for this variant; see get_ref() for the contract.
+ * @p out_value points into the slot for inline values and into the arena
+ * for external ones.
+ */
+static int VT_(get_ref)(const uint8_t *key, const uint8_t **out_value,
+                        uint16_t *value_len, uint32_t *version) {
+    uint32_t hash  = (uint32_t)(XXH3_64bits(key, VT_KEY_SIZE) & 0xFFFFFFFF);
+    size_t   home  = hash & MASK;
+    size_t   index = home;
+    size_t   dist  = 0;
+
+    while (1) {
+        struct VT_(slot) *slot = &VT_(table)[index];
+
+        if (slot->status == EMPTY) {
+            TABLE_PROBE(get, dist + 1, -1);
+            return -1;
+        }
+
+        if (slot->hash == hash &&
+            memcmp(slot->key, key, VT_KEY_SIZE) == 0) {
+            *out_value = VT_(is_external)(slot) ? arena_ptr(VT_(handle)(slot))
+                                                : slot->value;
+            *value_len = slot->value_len;
+            if (version)
+                *version = VT_(version)(slot);
+            TABLE_PROBE(get, dist + 1, 0);
+            return 0;
+        }
+
+        size_t occ_home = slot->hash & MASK;
+        size_t occ_dist = probe_distance(index, occ_home);
+
+        if (occ_dist < dist) {
+            TABLE_PROBE(get, dist + 1, -1);
+            return -1;
+        }
+
+        index = (index + 1) & MASK;
+        dist++;
+
+        if (dist >= TABLE_SIZE) {
+            TABLE_PROBE(get, dist, -1);
+            return -1;
+        }
+    }
+}
+
+/** Walks the whole slot array; see vegosh_for_each(). */
+static void VT_(for_each)(vegosh_visit_fn fn, void *ctx) {
+    for (size_t index = 0; index < TABLE_SIZE; index++) {
+        const struct VT_(slot) *slot = &VT_(table)[index];
+        if (slot->status != OCCUPIED)
+            continue;
+        fn(slot->key,
+           VT_(is_external)(slot) ? arena_ptr(VT_(handle)(slot)) : slot->value,
+           slot->value_len, VT_(version)(slot), ctx);
+    }
+}
+
+/**
+ * Visits the entries whose home bucket lies in [cursor, *next); see
+ * vegosh_scan() for the contract.
+ *
+ * Robin Hood keeps each cluster ordered by home bucket and entries only
+ * ever move forward from home, so walking slots from @p cursor yields
+ * entries with homes before @p cursor (skipped: an earlier batch had them)
+ * and then the rest in home order. An empty slot proves every bucket up to
+ * it is complete. A batch therefore always ends on a bucket boundary, and
+ * inserts between batches cannot carry an entry past the cursor unseen.
+ */
+static int VT_(scan)(uint32_t cursor, size_t count, vegosh_visit_fn fn,
+                     void *ctx, uint32_t *next) {
+    if (cursor >= TABLE_SIZE)
+        return -1;
+
+    size_t emitted = 0;
+    size_t last    = 0; /* home offset of the bucket being emitted */
+    size_t work    = 0;
+
+    for (size_t walk = 0; walk < TABLE_SIZE;
+         walk++, work += VT_SCAN_SLOT_COST) {
+        size_t index = (cursor + walk) & MASK;
+        const struct VT_(slot) *slot = &VT_(table)[index];
+        size_t done; /* buckets [cursor, cursor + done) are complete */
+
+        if (slot->status == EMPTY) {
+            done = walk + 1;
+        } else {
+            size_t dist = probe_distance(index, slot->hash & MASK);
+            if (dist > walk)
+                continue;
+            size_t off = walk - dist;
+            if (cursor + off < TABLE_SIZE &&
+                (off == last || (emitted < count && work < VEGOSH_SCAN_BUDGET))) {
+                fn(slot->key,
+                   VT_(is_external)(slot) ? arena_ptr(VT_(handle)(slot))
+                                          : slot->value,
+                   slot->value_len, VT_(version)(slot), ctx);
+                emitted++;
+                work += VEGOSH_SCAN_ENTRY_COST;
+                last = off;
+                continue;
+            }
+            done = off;
+        }
+
+        if (cursor + done >= TABLE_SIZE) {
+            *next = 0;
+            return 0;
+        }
+        if (emitted >= count || work >= VEGOSH_SCAN_BUDGET) {
+            *next = (uint32_t)(cursor + done);
+            return 0;
+        }
+    }
+    *next = 0;
+    return 0;
+}
+
+/** Bytes held by the live slot array. */
+static size_t VT_(footprint)(void) {
+    return sizeof(struct VT_(slot)) * TABLE_SIZE;
+}
+
+/* -------------------------------------------------------------------------
+ * Frozen index
+ *
+ * FREEZE compacts the live entries into a read-only Robin Hood array sized
+ * for FROZEN_LOAD_PERCENT load instead of the live table's ~47%. Homes are
+ * computed with a multiply-shift over the exact capacity, so the array need
+ * not be a power of two, and it never wraps: FROZEN_TAIL spare buckets
+ * absorb displacement past the end.
+ *
+ * A parallel array of 16-bit fingerprints (32 per cache line) is scanned
+ * first; lookups stop after frozen_max_dist + 1 buckets. freeze() keeps
+ * that at most FROZEN_MAX_PROBE + 1 = 32 buckets, so a lookup reads one or
+ * two fingerprint lines, then one slot for a hit plus one per 16-bit
+ * fingerprint collision in the window (about 1 lookup in 2000 at worst).
+ * Both arrays are mapped with transparent huge pages (frozen_alloc()).
+ * ---------------------------------------------------------------------- */
+
+/** Compacted entries of the frozen index; NULL while the table is live. */
+static struct VT_(slot) *VT_(frozen) = NULL;
+
+/** Fingerprints parallel to VT_(frozen); 0 marks an empty bucket. */
+static uint16_t *VT_(frozen_fp) = NULL;
+
+/** Number of home buckets in the frozen index, excluding FROZEN_TAIL. */
+static size_t VT_(frozen_cap) = 0;
+
+/** Longest displacement in the frozen index; bounds every lookup. */
+static size_t VT_(frozen_max_dist) = 0;
+
+static const struct VegoshTable VT_(descriptor);
+static const struct VegoshTable VT_(frozen_descriptor);
+
+/** Home bucket of @p hash in the frozen index. */
+static inline size_t VT_(frozen_home)(uint32_t hash) {
+    return (size_t)(((uint64_t)hash * VT_(frozen_cap)) >> 32);
+}
+
+/**
+ * Fingerprint of @p hash. Taken from the low bits because the home bucket
+ * comes from the high ones, so neighbours in a probe window don't share it.
+ */
+static inline uint16_t VT_(fingerprint)(uint32_t hash) {
+    uint16_t fp = (uint16_t)hash;
+    return fp ? fp : 1;
+}
+
+/** Unmaps the frozen arrays, sized by the current VT_(frozen_cap). */
+static void VT_(frozen_release)(void) {
+    size_t total = VT_(frozen_cap) + FROZEN_TAIL;
+    frozen_free(VT_(frozen), total * sizeof(struct VT_(slot)));
+    frozen_free(VT_(frozen_fp), total * sizeof(uint16_t));
+    VT_(frozen)    = NULL;
+    VT_(frozen_fp) = NULL;
+}
+
+/**
+ * Fills a new frozen index of @p cap home buckets from the live table,
+ * which is left untouched.
+ *
+ * @return 0 on success, -1 if allocation failed or a probe chain ran past
+ *         FROZEN_TAIL (nothing is kept).
+ */
+static int VT_(frozen_build)(size_t cap) {
+    size_t total = cap + FROZEN_TAIL;
+
+    VT_(frozen_cap) = cap;
+    VT_(frozen)     = frozen_alloc(total * sizeof(struct VT_(slot)));
+    VT_(frozen_fp)  = frozen_alloc(total * sizeof(uint16_t));
+    if (!VT_(frozen) || !VT_(frozen_fp)) {
+        perror("freeze allocation failed");
+        VT_(frozen_release)();
+        return -1;
+    }
+
+    struct VT_(slot) *frozen = VT_(frozen);
+    uint16_t *fps      = VT_(frozen_fp);
+    size_t    max_dist = 0;
+
+    for (size_t index = 0; index < TABLE_SIZE; index++) {
+        if (VT_(table)[index].status != OCCUPIED)
+            continue;
+
+        struct VT_(slot) temp = VT_(table)[index];
+        uint16_t temp_fp = VT_(fingerprint)(temp.hash);
+        size_t   pos     = VT_(frozen_home)(temp.hash);
+        size_t   dist    = 0;
+
+        while (1) {
+            if (pos == total) {
+                fprintf(stderr, "freeze: probe chain overran the tail\n");
+                VT_(frozen_release)();
+                return -1;
+            }
+
+            if (fps[pos] == 0) {
+                frozen[pos] = temp;
+                fps[pos]    = temp_fp;
+                if (dist > max_dist)
+                    max_dist = dist;
+                break;
+            }
+
+            /* Robin Hood: take the bucket from a richer incumbent. */
+            size_t occ_dist = pos - VT_(frozen_home)(frozen[pos].hash);
+            if (occ_dist < dist) {
+                struct VT_(slot) old = frozen[pos];
+                uint16_t old_fp      = fps[pos];
+                frozen[pos] = temp;
+                fps[pos]    = temp_fp;
+                if (dist > max_dist)
+                    max_dist = dist;
+                temp    = old;
+                temp_fp = old_fp;
+                dist    = occ_dist;
+            }
+
+            pos++;
+            dist++;
+        }
+    }
+
+    VT_(frozen_max_dist) = max_dist;
+    return 0;
+}
+
+/**
+ * Builds the frozen index from the live table, then returns the live slot
+ * array's pages to the kernel. Arena handles are carried over unchanged.
+ *
+ * An index whose longest displacement exceeds FROZEN_MAX_PROBE is rebuilt
+ * FROZEN_LOAD_STEP points emptier, so every lookup window fits in 32
+ * fingerprints.
+ *
+ * @return The frozen descriptor, or NULL if allocation failed, a probe
+ *         chain ran past FROZEN_TAIL or the bound could not be met above
+ *         FROZEN_MIN_LOAD (the live table is left untouched).
+ */
+static const struct VegoshTable *VT_(freeze)(void) {
+    size_t load = FROZEN_LOAD_PERCENT;
+
+    while (1) {
+        if (VT_(frozen_build)(*VT_(count) * 100 / load + 1) == -1)
+            return NULL;
+        if (VT_(frozen_max_dist) <= FROZEN_MAX_PROBE)
+            break;
+
+        VT_(frozen_release)();
+        if (load < FROZEN_MIN_LOAD + FROZEN_LOAD_STEP) {
+            fprintf(stderr, "freeze: max probe %zu at %zu%% load\n",
+                    VT_(frozen_max_dist), load);
+            return NULL;
+        }
+        printf("Frozen max probe %zu at %zu%% load; rebuilding at %zu%%\n",
+               VT_(frozen_max_dist), load, load - FROZEN_LOAD_STEP);
+        load -= FROZEN_LOAD_STEP;
+    }
+
+    region_release(VT_(table), sizeof(struct VT_(slot)) * TABLE_SIZE);
+    printf("Frozen %zu keys into %zu buckets (max probe %zu)\n",
+           (size_t)*VT_(count), VT_(frozen_cap) + FROZEN_TAIL,
+           VT_(frozen_max_dist));
+    return &VT_(frozen_descriptor);
+}
+
+/**
+ * Re-places every frozen entry into the (zeroed) live slot array and
+ * releases the frozen index.
+ *
+ * @return The live descriptor.
+ */
+static const struct VegoshTable *VT_(thaw)(void) {
+    *VT_(count) = 0;
+    for (size_t pos = 0; pos < VT_(frozen_cap) + FROZEN_TAIL; pos++) {
+        if (VT_(frozen_fp)[pos] != 0)
+            VT_(place)(&VT_(frozen)[pos], VT_(frozen)[pos].hash & MASK, 0);
+    }
+
+    VT_(frozen_release)();
+    return &VT_(descriptor);
+}
+
+/** Writes are rejected while frozen. */
+static int VT_(frozen_insert)(const uint8_t *key, const uint8_t *value,
+                              const uint16_t *value_len) {
+    (void)key;
+    (void)value;
+    (void)value_len;
+    return -3;
+}
+
+/** Writes are rejected while frozen. */
+static int VT_(frozen_restore)(const uint8_t *key, const uint8_t *value,
+                               const uint16_t *value_len, uint32_t version) {
+    (void)key;
+    (void)value;
+    (void)value_len;
+    (void)version;
+    return -3;
+}
+
+/** Writes are rejected while frozen. */
+static int VT_(frozen_cas)(const uint8_t *key, const uint8_t *value,
+                           const uint16_t *value_len, uint32_t expected,
+                           uint32_t *version) {
+    (void)key;
+    (void)value;
+    (void)value_len;
+    (void)expected;
+    (void)version;
+    return -3;
+}
+
+/** Bounded fingerprint scan; see the section comment above. */
+static int VT_(frozen_get_ref)(const uint8_t *key, const uint8_t **out_value,
+                               uint16_t *value_len, uint32_t *version) {
+    uint32_t hash  = (uint32_t)(XXH3_64bits(key, VT_KEY_SIZE) & 0xFFFFFFFF);
+    uint16_t fp    = VT_(fingerprint)(hash);
+    size_t   home  = VT_(frozen_home)(hash);
+    size_t   index = home;
+    size_t   end   = index + VT_(frozen_max_dist);
+
+    if (end >= VT_(frozen_cap) + FROZEN_TAIL)
+        end = VT_(frozen_cap) + FROZEN_TAIL - 1;
+
+    /* Start pulling in the first two slot lines while the fingerprints are
+     * scanned; most keys sit within a bucket or two of home. */
+    __builtin_prefetch(&VT_(frozen)[index]);
+    __builtin_prefetch((const char *)&VT_(frozen)[index] + 64);
+
+    for (; index <= end; index++) {
+        uint16_t f = VT_(frozen_fp)[index];
+        if (f == 0) {
+            TABLE_PROBE(get, index - home + 1, -1);
+            return -1; /* a probe chain never spans an empty bucket */
+        }
+        if (f != fp)
+            continue;
+
+        const struct VT_(slot) *slot = &VT_(frozen)[index];
+        if (memcmp(slot->key, key, VT_KEY_SIZE) == 0) {
+            *out_value = VT_(is_external)(slot) ? arena_ptr(VT_(handle)(slot))
+                                                : slot->value;
+            *value_len = slot->value_len;
+            if (version)
+                *version = VT_(version)(slot);
+            TABLE_PROBE(get, index - home + 1, 0);
+            return 0;
+        }
+    }
+    TABLE_PROBE(get, index - home, -1);
+    return -1;
+}
+
+/** Walks the frozen index; see vegosh_for_each(). */
+static void VT_(frozen_for_each)(vegosh_visit_fn fn, void *ctx) {
+    for (size_t pos = 0; pos < VT_(frozen_cap) + FROZEN_TAIL; pos++) {
+        if (VT_(frozen_fp)[pos] == 0)
+            continue;
+        const struct VT_(slot) *slot = &VT_(frozen)[pos];
+        fn(slot->key,
+           VT_(is_external)(slot) ? arena_ptr(VT_(handle)(slot)) : slot->value,
+           slot->value_len, VT_(version)(slot), ctx);
+    }
+}
+
+/**
+ * Frozen counterpart of VT_(scan)(): the same walk over frozen homes, which
+ * never wrap, so a scan ends at the last home bucket.
+ */
+static int VT_(frozen_scan)(uint32_t cursor, size_t count, vegosh_visit_fn fn,
+                            void *ctx, uint32_t *next) {
+    if (cursor >= VT_(frozen_cap))
+        return -1;
+
+    size_t emitted = 0;
+    size_t last    = 0;
+    size_t work    = 0;
+
+    for (size_t pos = cursor; pos < VT_(frozen_cap) + FROZEN_TAIL; pos++) {
+        size_t walk = pos - cursor;
+        size_t done;
+
+        /* An empty bucket only costs its fingerprint, 32 to a line. */
+        if (VT_(frozen_fp)[pos] == 0) {
+            work++;
+            done = walk + 1;
+        } else {
+            const struct VT_(slot) *slot = &VT_(frozen)[pos];
+            work += VT_SCAN_SLOT_COST;
+            size_t home = VT_(frozen_home)(slot->hash);
+            if (home < cursor)
+                continue;
+            size_t off = home - cursor;
+            if (home < VT_(frozen_cap) &&
+                (off == last || (emitted < count && work < VEGOSH_SCAN_BUDGET))) {
+                fn(slot->key,
+                   VT_(is_external)(slot) ? arena_ptr(VT_(handle)(slot))
+                                          : slot->value,
+                   slot->value_len, VT_(version)(slot), ctx);
+                emitted++;
+                work += VEGOSH_SCAN_ENTRY_COST;
+                last = off;
+                continue;
+            }
+            done = off;
+        }
+
+        if (cursor + done >= VT_(frozen_cap)) {
+            *next = 0;
+            return 0;
+        }
+        if (emitted >= count || work >= VEGOSH_SCAN_BUDGET) {
+            *next = (uint32_t)(cursor + done);
+            return 0;
+        }
+    }
+    *next = 0;
+    return 0;
+}
+
+/** Bytes held by the frozen entries and fingerprints. */
+static size_t VT_(frozen_footprint)(void) {
+    size_t total = VT_(frozen_cap) + FROZEN_TAIL;
+    return frozen_round(total * sizeof(struct VT_(slot))) +
+           frozen_round(total * sizeof(uint16_t));
+}
+
+/* -------------------------------------------------------------------------
+ * Descriptors
+ * ---------------------------------------------------------------------- */
+
+/** Live table, handed to vegosh.c's dispatcher. */
+static const struct VegoshTable VT_(descriptor) = {
+    .key_size     = VT_KEY_SIZE,
+    .value_size   = VT_VALUE_SIZE,
+    .slot_size    = VT_SLOT_SIZE,
+    .init         = VT_(init),
+    .region_bytes = VT_(region_bytes),
+    .insert       = VT_(insert),
+    .restore      = VT_(restore),
+    .cas          = VT_(cas),
+    .get_ref      = VT_(get_ref),
+    .for_each     = VT_(for_each),
+    .scan         = VT_(scan),
+    .footprint    = VT_(footprint),
+    .freeze       = VT_(freeze),
+};
+
+/** Frozen index; swapped in by vegosh_freeze(). */
+static const struct VegoshTable VT_(frozen_descriptor) = {
+    .key_size     = VT_KEY_SIZE,
+    .value_size   = VT_VALUE_SIZE,
+    .slot_size    = VT_SLOT_SIZE,
+    .init         = VT_(init),
+    .region_bytes = VT_(region_bytes),
+    .insert       = VT_(frozen_insert),
+    .restore      = VT_(frozen_restore),
+    .cas          = VT_(frozen_cas),
+    .get_ref      = VT_(frozen_get_ref),
+    .for_each     = VT_(frozen_for_each),
+    .scan         = VT_(frozen_scan),
+    .footprint    = VT_(frozen_footprint),
+    .thaw         = VT_(thaw),
+};
+
+#undef VT_RESERVED
+#undef VT_SCAN_SLOT_COST
+#undef VT_
+#undef VT_CAT
+#undef VT_CAT_
+#undef VT_NAME
+#undef VT_KEY_SIZE
+#undef VT_VALUE_SIZE
+#undef VT_SLOT_SIZE